@@ -5,6 +5,16 @@
 
   This is the code we use to test the Qwiic Mux PCS9846 during production.
 
+  The tests are run by QwPCA9846ProductionTest: detect, Device ID, port latch /
+  read back, and a downstream short test on each port. There are no fixed
+  delays: the fixture waits for a board to be inserted, tests it straight away,
+  then waits for it to be removed.
+
+  Each result is printed as one CSV line:
+    sequence,result,failedPorts,detectUs,idUs,latchUs,shortUs
+  result: 0 = pass, 1 = no device, 2 = bad ID, 3 = latch, 4 = short, 5 = no bus
+  failedPorts is a bit mask: bit 0 = port 0, etc.
+
   SparkFun labored with love to create this code. Feel like supporting open
   source? Buy a board from SparkFun!
   https://www.sparkfun.com/products/22362
@@ -15,6 +25,9 @@
 #include <SparkFun_PCA9846.h> //Click here to get the library: http://librarymanager/All#SparkFun_PCA9846_Mux
 
 SparkFun_PCA9846 myMux;
+QwPCA9846ProductionTest tester(myMux);
+
+bool boardTested = false; // Wait for the board to be removed before testing again
 
 void setup()
 {
@@ -23,54 +36,45 @@ void setup()
   Serial.begin(115200);
   Serial.println();
   Serial.println("PCA9846 Qwiic Mux Production Test");
+  Serial.println(F("sequence,result,failedPorts,detectUs,idUs,latchUs,shortUs"));
 
   pinMode(LED_BUILTIN, OUTPUT);
   digitalWrite(LED_BUILTIN, LOW);
+
+  Wire.begin();
+
+  // Attach the mux. There is probably no board in the fixture yet, so ignore the result
+  myMux.begin();
 }
 
 void loop()
 {
-  delay(250); // Try every 0.25 seconds
-
-  Wire.begin();
-
-  Wire.beginTransmission(0x70); // Detect mux on address 0x70
-  if (Wire.endTransmission() != 0)
+  if (!tester.isBoardPresent())
   {
-    digitalWrite(LED_BUILTIN, LOW);
-    Wire.end();
-    Serial.println(F("Error: nothing detected on address 0x70"));
-    return;
-  }
-  
-  //Initialize mux - reads the "Who Am I" Device ID from address 0x7C
-  if (myMux.begin() == false)
-  {
-    digitalWrite(LED_BUILTIN, LOW);
-    Wire.end();
-    Serial.println(F("Error: mux .begin failed"));
+    if (boardTested)
+      digitalWrite(LED_BUILTIN, LOW); // Board removed
+    boardTested = false;
     return;
   }
 
-  //Enable all four ports, then read back the port configuration
-  //This should check for shorts on the multiplexed ports
-  if (myMux.setPortState(0x0F) == false)
-  {
-    digitalWrite(LED_BUILTIN, LOW);
-    Wire.end();
-    Serial.println(F("Error: mux .setPortState failed"));
+  if (boardTested)
     return;
-  }
-  if (myMux.getPortState() != 0x0F)
+
+  QwPCA9846TestRecord record;
+  bool passed = tester.run(record);
+
+  Serial.print(record.sequence);
+  Serial.print(F(","));
+  Serial.print(record.result);
+  Serial.print(F(","));
+  Serial.print(record.failedPorts);
+  for (uint8_t stage = 0; stage < kQwStageCount; stage++)
   {
-    digitalWrite(LED_BUILTIN, LOW);
-    Wire.end();
-    Serial.println(F("Error: mux .getPortState failed"));
-    return;
+    Serial.print(F(","));
+    Serial.print(record.stageMicros[stage]);
   }
+  Serial.println();
 
-  // All good!
-  Serial.println(F("Test passed!"));
-  digitalWrite(LED_BUILTIN, HIGH);
-  Wire.end();
-}
\ No newline at end of file
+  digitalWrite(LED_BUILTIN, passed ? HIGH : LOW);
+  boardTested = true;
+}
@@ -0,0 +1,127 @@
+/*
+  Use the PCA9846 Qwiic Mux to access multiple I2C devices on seperate busses.
+  By: SparkFun Electronics
+  Date: October 16th, 2026
+
+  This example does not need any hardware. It runs the library against QwSimBus,
+  a software model of the PCA9846 and its downstream devices, and reports what
+  each public method costs on the bus: transactions, data bytes, and the bus
+  time at 100kHz, 400kHz and 1MHz.
+
+  Run it after changing the library to check that no method has started using
+  more transactions than it did before. Both the uncached and the cached
+  (enableCache) modes are reported. The same figures are checked against a
+  baseline on a desktop machine by test/test_bus_benchmark (see test/CMakeLists.txt).
+
+  Serial.print it out at 115200 baud to serial monitor.
+
+  SparkFun labored with love to create this code. Feel like supporting open
+  source? Buy a board from SparkFun!
+  https://www.sparkfun.com/products/22362
+*/
+
+#include <SparkFun_PCA9846.h> //Click here to get the library: http://librarymanager/All#SparkFun_PCA9846_Mux
+#include <sfe_sim_bus.h>
+
+sfe_PCA9846::QwSimBus simBus(SFE_PCA9846_MUX_DEFAULT_ADDRESS);
+QwDevPCA9846 myMux;
+
+uint8_t sensorRegisters[4][16]; // One simulated sensor on each port
+
+void report(const char *name)
+{
+  sfe_PCA9846::QwSimBusStats stats;
+  simBus.getStats(stats);
+
+  Serial.print(name);
+  Serial.print(F(","));
+  Serial.print(stats.transactions);
+  Serial.print(F(","));
+  Serial.print(stats.bytes);
+  Serial.print(F(","));
+  Serial.print(simBus.busTimeMicros(100000));
+  Serial.print(F(","));
+  Serial.print(simBus.busTimeMicros(400000));
+  Serial.print(F(","));
+  Serial.println(simBus.busTimeMicros(1000000));
+
+  simBus.resetStats();
+}
+
+void runBenchmark()
+{
+  uint8_t buffer[8] = {0};
+
+  Serial.println(F("method,transactions,bytes,us@100kHz,us@400kHz,us@1MHz"));
+
+  simBus.resetStats();
+  myMux.init();
+  report("init");
+
+  myMux.isConnected();
+  report("isConnected");
+
+  myMux.getUniqueId();
+  report("getUniqueId");
+
+  myMux.setPort(1);
+  report("setPort");
+
+  myMux.setPort(1);
+  report("setPort (same port)");
+
+  myMux.getPort();
+  report("getPort");
+
+  myMux.setPortState(0x05);
+  report("setPortState");
+
+  myMux.getPortState();
+  report("getPortState");
+
+  myMux.enablePort(1);
+  report("enablePort");
+
+  myMux.disablePort(1);
+  report("disablePort");
+
+  myMux.write(0x02);
+  report("write");
+
+  myMux.read(buffer);
+  report("read");
+
+  myMux.writeRegisterRegion(0x01, buffer, 1);
+  report("writeRegisterRegion");
+
+  myMux.readRegisterRegion(0x01, buffer, 1);
+  report("readRegisterRegion");
+}
+
+void setup()
+{
+  delay(1000);
+
+  Serial.begin(115200);
+  Serial.println();
+  Serial.println("PCA9846 Qwiic Mux Bus Benchmark Example");
+
+  for (uint8_t port = 0; port < 4; port++)
+    simBus.addDevice(port, 0x48, sensorRegisters[port], sizeof(sensorRegisters[port]));
+
+  myMux.setCommunicationBus(simBus, SFE_PCA9846_MUX_DEFAULT_ADDRESS);
+
+  Serial.println();
+  Serial.println(F("Uncached:"));
+  runBenchmark();
+
+  myMux.enableCache();
+
+  Serial.println();
+  Serial.println(F("Cached:"));
+  runBenchmark();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,117 @@
+/*
+  Use the PCA9846 Qwiic Mux to access multiple I2C devices on seperate busses.
+  By: SparkFun Electronics
+  Date: October 16th, 2026
+
+  SparkFun_PCA9846 talks to the bus through the QwIDeviceBus interface, so every
+  bus call is a virtual call. SparkFun_PCA9846Static has the same API but is
+  built on QwDevPCA9846Static<>, where the bus type is fixed at compile time and
+  every bus call is a direct (and usually inlined) call.
+
+  To use it, just change the type of the mux object:
+    SparkFun_PCA9846 myMux;        // Virtual bus
+    SparkFun_PCA9846Static myMux;  // Compile-time bus
+
+  This example does not need any hardware. It compares the CPU time of the two
+  variants on NullBus, a bus which does nothing but remember the mux control
+  register. With no bus work to hide it, what is left is the library and the
+  call overhead. On a real bus, each transfer takes far longer than the
+  dispatch, so the difference is in flash size and call overhead, not speed.
+
+  To compare flash use, build Example1_BasicControl as it is, then again with
+  SparkFun_PCA9846 replaced by SparkFun_PCA9846Static, and compare the sketch
+  sizes reported by the IDE.
+
+  Serial.print it out at 115200 baud to serial monitor.
+
+  SparkFun labored with love to create this code. Feel like supporting open
+  source? Buy a board from SparkFun!
+  https://www.sparkfun.com/products/22362
+*/
+
+#include <SparkFun_PCA9846.h> //Click here to get the library: http://librarymanager/All#SparkFun_PCA9846_Mux
+
+#define ITERATIONS 10000
+
+// Every transfer succeeds at once. Only the mux control register and its Device ID are modelled
+class NullBus : public sfe_PCA9846::QwIDeviceBus
+{
+public:
+  bool ping(uint8_t) { return true; }
+  bool write(uint8_t, uint8_t data)
+  {
+    control = data;
+    return true;
+  }
+  bool writeRegisterByte(uint8_t, uint8_t, uint8_t) { return true; }
+  bool writeRegisterRegion(uint8_t, uint8_t, const uint8_t *, uint16_t) { return true; }
+  bool read(uint8_t, uint8_t *data)
+  {
+    *data = control;
+    return true;
+  }
+  bool readRegisterRegion(uint8_t, uint8_t, uint8_t *data, uint8_t length)
+  {
+    for (uint8_t i = 0; i < length; i++)
+      data[i] = (i < 3) ? (uint8_t)(SFE_PCA9846_MUX_DEVICE_ID >> (8 * (2 - i))) : 0;
+    return true;
+  }
+
+  uint8_t control = 0;
+};
+
+NullBus nullBus;
+
+QwDevPCA9846 virtualMux;
+QwDevPCA9846Static<NullBus> staticMux;
+
+volatile uint8_t sink; // Keeps the compiler from dropping the loop
+
+template <typename Mux>
+unsigned long timeIt(Mux &mux)
+{
+  unsigned long start = micros();
+
+  for (unsigned int i = 0; i < ITERATIONS; i++)
+  {
+    mux.setPort(i & 3);
+    sink = mux.getPortState();
+  }
+
+  return micros() - start;
+}
+
+void setup()
+{
+  delay(1000);
+
+  Serial.begin(115200);
+  Serial.println();
+  Serial.println("PCA9846 Qwiic Mux Static Bus Example");
+
+  virtualMux.setCommunicationBus(nullBus, SFE_PCA9846_MUX_DEFAULT_ADDRESS);
+  staticMux.setCommunicationBus(nullBus, SFE_PCA9846_MUX_DEFAULT_ADDRESS);
+
+  if ((virtualMux.init() == false) || (staticMux.init() == false))
+  {
+    Serial.println("Mux not detected. Freezing...");
+    while (1)
+      ;
+  }
+
+  unsigned long virtualTime = timeIt(virtualMux);
+  unsigned long staticTime = timeIt(staticMux);
+
+  Serial.print(F("setPort + getPortState x "));
+  Serial.println(ITERATIONS);
+  Serial.print(F("Virtual bus:       "));
+  Serial.print(virtualTime);
+  Serial.println(F("us"));
+  Serial.print(F("Compile-time bus:  "));
+  Serial.print(staticTime);
+  Serial.println(F("us"));
+}
+
+void loop()
+{
+}
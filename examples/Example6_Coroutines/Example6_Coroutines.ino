@@ -0,0 +1,134 @@
+/*
+  Use the PCA9846 Qwiic Mux to access multiple I2C devices on seperate busses.
+  By: SparkFun Electronics
+  Date: October 16th, 2026
+
+  With a C++20 compiler (e.g. the ESP32 Arduino core 3.x), mux operations can
+  be written as coroutines: each task co_awaits setPort(), getPortState(),
+  readRegisterRegion() and transferOnPort(), and a QwPCA9846Executor runs the
+  tasks side by side, polling the transfers in flight.
+
+  This example does not need any hardware. Two muxes are modelled with
+  QwSimBus, each behind a QwPolledAsyncBus which takes a fixed number of polls
+  per transfer. One task reads a sensor on every port of each mux, and a third
+  task does other work in between. The tick counts are the same on every run.
+
+  Serial.print it out at 115200 baud to serial monitor.
+
+  SparkFun labored with love to create this code. Feel like supporting open
+  source? Buy a board from SparkFun!
+  https://www.sparkfun.com/products/22362
+*/
+
+#include <SparkFun_PCA9846.h> //Click here to get the library: http://librarymanager/All#SparkFun_PCA9846_Mux
+#include <sfe_sim_bus.h>
+
+#if defined(SFE_PCA9846_HAS_COROUTINES)
+
+#define BUSY_POLLS 3 // Polls each simulated transfer takes
+
+sfe_PCA9846::QwSimBus simBus[2] = {sfe_PCA9846::QwSimBus(0x70), sfe_PCA9846::QwSimBus(0x71)};
+QwDevPCA9846 mux[2];
+sfe_PCA9846::QwPolledAsyncBus asyncBus[2] = {sfe_PCA9846::QwPolledAsyncBus(simBus[0], BUSY_POLLS),
+                                             sfe_PCA9846::QwPolledAsyncBus(simBus[1], BUSY_POLLS)};
+
+QwPCA9846Executor executor;
+QwDevPCA9846Coro coroMux[2] = {QwDevPCA9846Coro(mux[0], asyncBus[0], executor), QwDevPCA9846Coro(mux[1], asyncBus[1], executor)};
+
+uint8_t sensorRegisters[2][4][16]; // One simulated sensor on each port
+
+QwPCA9846Task readSensors(uint8_t muxNumber)
+{
+  for (uint8_t port = 0; port < 4; port++)
+  {
+    uint8_t data[2];
+    bool success = co_await coroMux[muxNumber].readRegisterRegion(port, 0x48, 0x00, data, sizeof(data));
+
+    Serial.print(F("Tick "));
+    Serial.print(executor.getTicks());
+    Serial.print(F(": mux "));
+    Serial.print(muxNumber);
+    Serial.print(F(" port "));
+    Serial.print(port);
+    if (success)
+    {
+      Serial.print(F(" read 0x"));
+      Serial.println((data[0] << 8) | data[1], HEX);
+    }
+    else
+      Serial.println(F(" failed"));
+  }
+
+  uint8_t portBits;
+  if (co_await coroMux[muxNumber].getPortState(portBits))
+  {
+    Serial.print(F("Mux "));
+    Serial.print(muxNumber);
+    Serial.print(F(" left on port bits 0x"));
+    Serial.println(portBits, HEX);
+  }
+}
+
+uint32_t otherWork = 0;
+
+QwPCA9846Task doOtherWork()
+{
+  for (uint8_t i = 0; i < 20; i++)
+  {
+    otherWork++;
+    co_await executor.yield();
+  }
+}
+
+void setup()
+{
+  delay(1000);
+
+  Serial.begin(115200);
+  Serial.println();
+  Serial.println("PCA9846 Qwiic Mux Coroutines Example");
+
+  for (uint8_t m = 0; m < 2; m++)
+  {
+    for (uint8_t port = 0; port < 4; port++)
+    {
+      sensorRegisters[m][port][0] = m + 1;
+      sensorRegisters[m][port][1] = port;
+      simBus[m].addDevice(port, 0x48, sensorRegisters[m][port], sizeof(sensorRegisters[m][port]));
+    }
+
+    mux[m].setCommunicationBus(simBus[m], m == 0 ? 0x70 : 0x71);
+    mux[m].init();
+    mux[m].enableCache();
+  }
+
+  executor.spawn(readSensors(0));
+  executor.spawn(readSensors(1));
+  executor.spawn(doOtherWork());
+
+  uint32_t ticks = executor.run();
+
+  Serial.print(F("All tasks done in "));
+  Serial.print(ticks);
+  Serial.print(F(" ticks, with "));
+  Serial.print(otherWork);
+  Serial.println(F(" steps of other work in between"));
+}
+
+#else
+
+void setup()
+{
+  delay(1000);
+
+  Serial.begin(115200);
+  Serial.println();
+  Serial.println("PCA9846 Qwiic Mux Coroutines Example");
+  Serial.println("This example needs a C++20 compiler, e.g. the ESP32 Arduino core 3.x");
+}
+
+#endif
+
+void loop()
+{
+}
@@ -0,0 +1,137 @@
+/*
+  Use the PCA9846 Qwiic Mux to access multiple I2C devices on seperate busses.
+  By: SparkFun Electronics
+  Date: October 16th, 2026
+
+  Boards with more than one I2C controller (e.g. the ESP32, with Wire and Wire1)
+  can run a mux on each controller in parallel. QwPCA9846ShardedExecutor gives
+  each mux - a shard - a thread of its own, and runs the jobs submitted to a
+  port of a shard on that shard's thread.
+
+  With real hardware, the shards are added with:
+    executor.addShard(Wire, 0x70);
+    executor.addShard(Wire1, 0x70);
+
+  This example does not need any hardware. The muxes are modelled with
+  QwSimBus, set to take the real bus time of each transfer at 400kHz. The same
+  sensor reads are run on one shard, then spread over two, and the throughput
+  and the utilization of each shard are reported.
+
+  Needs std::thread (e.g. ESP32 or a desktop build).
+
+  Serial.print it out at 115200 baud to serial monitor.
+
+  SparkFun labored with love to create this code. Feel like supporting open
+  source? Buy a board from SparkFun!
+  https://www.sparkfun.com/products/22362
+*/
+
+#include <SparkFun_PCA9846.h> //Click here to get the library: http://librarymanager/All#SparkFun_PCA9846_Mux
+#include <sfe_sim_bus.h>
+
+#if defined(SFE_PCA9846_HAS_SHARDS)
+
+#define READS 400
+
+sfe_PCA9846::QwSimBus simBus[2];
+QwDevPCA9846 mux[2];
+
+uint8_t sensorRegisters[2][4][16]; // One simulated sensor on each port of each mux
+
+void sleepMicros(uint32_t microseconds)
+{
+  std::this_thread::sleep_for(std::chrono::microseconds(microseconds));
+}
+
+bool readSensor(sfe_PCA9846::QwIDeviceBus &bus, void *)
+{
+  uint8_t data[6];
+  return bus.readRegisterRegion(0x48, 0x00, data, sizeof(data));
+}
+
+void runReads(uint8_t shards)
+{
+  QwPCA9846ShardedExecutor executor;
+
+  for (uint8_t shard = 0; shard < shards; shard++)
+    executor.addShard(mux[shard]);
+
+  executor.start();
+
+  unsigned long start = millis();
+
+  for (uint16_t i = 0; i < READS; i++)
+    executor.submit(SFE_PCA9846_SHARD_PORT(i % shards, (i / shards) % 4), readSensor);
+
+  executor.wait();
+
+  unsigned long elapsed = millis() - start;
+
+  Serial.print(shards);
+  Serial.print(F(" shard(s): "));
+  Serial.print(READS);
+  Serial.print(F(" reads in "));
+  Serial.print(elapsed);
+  Serial.println(F("ms"));
+
+  for (uint8_t shard = 0; shard < shards; shard++)
+  {
+    QwPCA9846ShardStats stats;
+    executor.getStats(shard, stats);
+
+    Serial.print(F("  Shard "));
+    Serial.print(shard);
+    Serial.print(F(": "));
+    Serial.print(stats.jobs);
+    Serial.print(F(" jobs, "));
+    Serial.print(stats.failures);
+    Serial.print(F(" failed, "));
+    Serial.print(stats.utilization);
+    Serial.println(F("% busy"));
+  }
+
+  executor.stop();
+}
+
+void setup()
+{
+  delay(1000);
+
+  Serial.begin(115200);
+  Serial.println();
+  Serial.println("PCA9846 Qwiic Mux Sharded Buses Example");
+
+  for (uint8_t m = 0; m < 2; m++)
+  {
+    for (uint8_t port = 0; port < 4; port++)
+      simBus[m].addDevice(port, 0x48, sensorRegisters[m][port], sizeof(sensorRegisters[m][port]));
+
+    simBus[m].setClock(400000);
+    simBus[m].setDelayFunction(sleepMicros);
+
+    mux[m].setCommunicationBus(simBus[m], SFE_PCA9846_MUX_DEFAULT_ADDRESS);
+    mux[m].init();
+    mux[m].enableCache(); // Select a port only when the selection changes
+  }
+
+  runReads(1);
+  runReads(2);
+}
+
+#else
+
+void setup()
+{
+  delay(1000);
+
+  Serial.begin(115200);
+  Serial.println();
+  Serial.println("PCA9846 Qwiic Mux Sharded Buses Example");
+  Serial.println("This example needs std::thread, e.g. on an ESP32");
+}
+
+#endif
+
+void loop()
+{
+}
@@ -15,6 +15,22 @@
 #pragma once
 #include "sfe_pca9846.h"
 #include "sfe_bus.h"
+#include "sfe_bus_stats.h"
+#include "sfe_bus_trace.h"
+#include "sfe_port_bus.h"
+#include "sfe_pca9846_tree.h"
+#include "sfe_pca9846_scheduler.h"
+#include "sfe_pca9846_static.h"
+#include "sfe_pca9846_async.h"
+#include "sfe_pca9846_coro.h"
+#include "sfe_pca9846_arbiter.h"
+#include "sfe_pca9846_shards.h"
+#include "sfe_pca9846_recovery.h"
+#include "sfe_pca9846_poller.h"
+#include "sfe_pca9846_production.h"
+#include "sfe_pca9846_transaction.h"
+#include "sfe_pca9846_replay.h"
+#include "sfe_pca9846_hotplug.h"
 #include <Wire.h>
 
 class SparkFun_PCA9846 : public QwDevPCA9846
@@ -73,3 +89,38 @@ private:
     // I2C bus class
     sfe_PCA9846::QwI2C _i2cBus;
 };
+
+// SparkFun_PCA9846Static has the same begin() / setPort() API as SparkFun_PCA9846,
+// but calls QwI2C directly instead of through the QwIDeviceBus interface.
+class SparkFun_PCA9846Static : public QwDevPCA9846Static<sfe_PCA9846::QwI2C>
+{
+
+public:
+    SparkFun_PCA9846Static(){};
+
+    // Version 1:
+    // User skips passing in an I2C object which then defaults to Wire.
+    bool begin(uint8_t deviceAddress = SFE_PCA9846_MUX_DEFAULT_ADDRESS)
+    {
+        setCommunicationBus(_i2cBus, deviceAddress);
+
+        _i2cBus.init();
+
+        return this->QwDevPCA9846Static<sfe_PCA9846::QwI2C>::init();
+    }
+
+    // Version 2:
+    // User passes in an I2C object and an address (optional).
+    bool begin(TwoWire &wirePort, uint8_t deviceAddress = SFE_PCA9846_MUX_DEFAULT_ADDRESS)
+    {
+        setCommunicationBus(_i2cBus, deviceAddress);
+
+        _i2cBus.init(wirePort, true);
+
+        return this->QwDevPCA9846Static<sfe_PCA9846::QwI2C>::init();
+    }
+
+private:
+    // I2C bus class
+    sfe_PCA9846::QwI2C _i2cBus;
+};
@@ -0,0 +1,102 @@
+// sfe_async_bus.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Non-blocking transfers on top of a blocking bus. See sfe_async_bus.h
+
+#include "sfe_async_bus.h"
+
+namespace sfe_PCA9846
+{
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructor
+    //
+
+    QwPolledAsyncBus::QwPolledAsyncBus(QwIDeviceBus &bus, uint16_t busyPolls) : _bus{bus}, _busyPolls{busyPolls}, _pollsLeft{0}, _status{kQwAsyncIdle}
+    {
+    }
+
+    bool QwPolledAsyncBus::startTransfer(const QwAsyncTransfer &transfer)
+    {
+        if (_status == kQwAsyncBusy)
+            return false;
+
+        _transfer = transfer;
+        _pollsLeft = _busyPolls;
+        _status = kQwAsyncBusy;
+
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // poll()
+    //
+    // The transfer runs, in one go, on the poll after the busy polls have elapsed
+
+    QwAsyncStatus QwPolledAsyncBus::poll()
+    {
+        if (_status != kQwAsyncBusy)
+            return _status;
+
+        if (_pollsLeft > 0)
+        {
+            _pollsLeft--;
+            return _status;
+        }
+
+        _status = execute() ? kQwAsyncDone : kQwAsyncError;
+        return _status;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // execute()
+    //
+    // The first byte written is treated as the register offset
+
+    bool QwPolledAsyncBus::execute()
+    {
+        const QwAsyncTransfer &t = _transfer;
+
+        if (t.rxLength == 0)
+        {
+            if (t.txLength == 0)
+                return _bus.ping(t.address);
+
+            if (t.txLength == 1)
+                return _bus.write(t.address, t.tx[0]);
+
+            return _bus.writeRegisterRegion(t.address, t.tx[0], t.tx + 1, t.txLength - 1);
+        }
+
+        if ((t.txLength == 0) && (t.rxLength == 1))
+            return _bus.read(t.address, t.rx);
+
+        if ((t.txLength == 1) && (t.rxLength <= 0xFF))
+            return _bus.readRegisterRegion(t.address, t.tx[0], t.rx, (uint8_t)t.rxLength);
+
+        return false; // Not expressible on QwIDeviceBus
+    }
+
+}
@@ -0,0 +1,98 @@
+// sfe_async_bus.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The following classes specify non-blocking communication over I2C.
+// A transfer is started with startTransfer() and driven to completion by
+// calling poll() - from the main loop, or from wherever suits the backend.
+// Interrupt- or DMA-driven backends implement QwIAsyncDeviceBus directly; their
+// poll() only has to report what the interrupt handler has done.
+//
+// QwPolledAsyncBus runs transfers on any blocking QwIDeviceBus. It makes the
+// non-blocking API usable with QwI2C, and, with a simulated bus and a fixed
+// number of busy polls, gives deterministic timing on a desktop machine.
+
+#pragma once
+
+#include "sfe_bus.h"
+
+namespace sfe_PCA9846
+{
+    enum QwAsyncStatus
+    {
+        kQwAsyncIdle = 0, // No transfer started
+        kQwAsyncBusy,     // In progress - keep polling
+        kQwAsyncDone,     // Completed successfully
+        kQwAsyncError     // Completed with an error
+    };
+
+    // Write txLength bytes, then - after a repeated START if both are non-zero - read rxLength bytes.
+    // A transfer with neither is a ping. The buffers must stay valid until the transfer completes.
+    struct QwAsyncTransfer
+    {
+        uint8_t address;
+        const uint8_t *tx;
+        uint16_t txLength;
+        uint8_t *rx;
+        uint16_t rxLength;
+    };
+
+    // The following abstract class is used an interface for non-blocking implementations.
+    class QwIAsyncDeviceBus
+    {
+    public:
+        // Start a transfer. Returns false if a transfer is still in progress
+        virtual bool startTransfer(const QwAsyncTransfer &transfer) = 0;
+
+        // Advance the transfer in progress and return its status
+        virtual QwAsyncStatus poll() = 0;
+
+        // Why the last transfer failed
+        virtual uint8_t getLastError() { return SFE_PCA9846_BUS_ERROR_OTHER; }
+    };
+
+    // Runs each transfer on a blocking bus, after it has been polled busyPolls times.
+    class QwPolledAsyncBus : public QwIAsyncDeviceBus
+    {
+    public:
+        QwPolledAsyncBus(QwIDeviceBus &bus, uint16_t busyPolls = 0);
+
+        bool startTransfer(const QwAsyncTransfer &transfer);
+
+        QwAsyncStatus poll();
+
+        uint8_t getLastError() { return _bus.getLastError(); }
+
+    private:
+        // Map the transfer onto the blocking bus
+        bool execute();
+
+        QwIDeviceBus &_bus;
+        uint16_t _busyPolls;
+        uint16_t _pollsLeft;
+        QwAsyncTransfer _transfer;
+        QwAsyncStatus _status;
+    };
+
+};
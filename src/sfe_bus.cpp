@@ -28,16 +28,231 @@
 // an abstract interface (QwIDeviceBus) is used.
 
 #include "sfe_bus.h"
-#include <Arduino.h>
 
-//////////////////////////////////////////////////////////////////////////////////////////////////
-// Constructor
-//
+#if defined(ARDUINO)
+#include <Arduino.h>
+#endif
 
 namespace sfe_PCA9846
 {
+    uint32_t segmentsLength(const QwWriteSegment *segments, uint8_t count)
+    {
+        uint32_t length = 0;
+        for (uint8_t i = 0; i < count; i++)
+            length += segments[i].length;
+        return length;
+    }
+
+    uint32_t segmentsLength(const QwReadSegment *segments, uint8_t count)
+    {
+        uint32_t length = 0;
+        for (uint8_t i = 0; i < count; i++)
+            length += segments[i].length;
+        return length;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // readRegisterRegionChunked()
+    //
+    // Split a long read into reads which fit the bus buffer, straight into the caller's buffer.
+    // The register offset advances with each chunk unless autoIncrement is false (e.g. a FIFO).
 
-    QwI2C::QwI2C(void) : _i2cPort{nullptr}
+    bool QwIDeviceBus::readRegisterRegionChunked(uint8_t address, uint8_t offset, uint8_t *data, uint32_t length, bool autoIncrement)
+    {
+        uint16_t maxChunk = maxTransferLength();
+        if (maxChunk > 0xFF)
+            maxChunk = 0xFF; // readRegisterRegion() takes a uint8_t length
+        if (maxChunk == 0)
+            maxChunk = 1; // Never a zero length chunk, which would loop forever
+
+        while (length > 0)
+        {
+            uint8_t chunk = (length > maxChunk) ? (uint8_t)maxChunk : (uint8_t)length;
+
+            if (!readRegisterRegion(address, offset, data, chunk))
+                return false;
+
+            data += chunk;
+            length -= chunk;
+            if (autoIncrement)
+                offset += chunk;
+        }
+
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // writeRegisterRegionChunked()
+    //
+    // Split a long write into writes which fit the bus buffer. The register offset takes one
+    // byte of each write.
+
+    bool QwIDeviceBus::writeRegisterRegionChunked(uint8_t address, uint8_t offset, const uint8_t *data, uint32_t length, bool autoIncrement)
+    {
+        uint16_t maxChunk = maxTransferLength();
+        maxChunk = (maxChunk > 1) ? maxChunk - 1 : 1; // At least one data byte after the offset
+
+        do
+        {
+            uint16_t chunk = (length > maxChunk) ? maxChunk : (uint16_t)length;
+
+            if (!writeRegisterRegion(address, offset, data, chunk))
+                return false;
+
+            data += chunk;
+            length -= chunk;
+            if (autoIncrement)
+                offset += chunk;
+        } while (length > 0);
+
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // readRegisterStream()
+    //
+    // Read length bytes, one bus-buffer-sized chunk at a time, handing each chunk to the sink.
+    // Only one chunk is ever held in memory.
+
+    bool QwIDeviceBus::readRegisterStream(uint8_t address, uint8_t offset, uint32_t length, QwReadSink sink, void *context, bool autoIncrement)
+    {
+        uint8_t buffer[SFE_PCA9846_I2C_BUFFER_LENGTH];
+
+        uint16_t maxChunk = maxTransferLength();
+        if (maxChunk > sizeof(buffer))
+            maxChunk = sizeof(buffer);
+        if (maxChunk > 0xFF)
+            maxChunk = 0xFF;
+        if (maxChunk == 0)
+            maxChunk = 1;
+
+        while (length > 0)
+        {
+            uint8_t chunk = (length > maxChunk) ? (uint8_t)maxChunk : (uint8_t)length;
+
+            if (!readRegisterRegion(address, offset, buffer, chunk))
+                return false;
+
+            if (!sink(buffer, chunk, context))
+                return false; // The sink asked us to stop
+
+            length -= chunk;
+            if (autoIncrement)
+                offset += chunk;
+        }
+
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transfer()
+    //
+    // Generic version, built from the single-purpose calls
+
+    bool QwIDeviceBus::transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength)
+    {
+        if ((txLength == 0) && (rxLength == 0))
+            return ping(address);
+
+        if (rxLength == 0)
+            return writeRegisterRegion(address, tx[0], tx + 1, txLength - 1);
+
+        if ((txLength == 1) && (rxLength <= 0xFF))
+            return readRegisterRegion(address, tx[0], rx, (uint8_t)rxLength);
+
+        if ((txLength == 0) && (rxLength == 1))
+            return read(address, rx);
+
+        return false; // Not supported by this bus
+    }
+
+    bool QwIDeviceBus::transferOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const uint8_t *tx, uint16_t txLength,
+                                      uint8_t *rx, uint16_t rxLength)
+    {
+        if (!write(muxAddress, portBits))
+            return false;
+
+        return transfer(address, tx, txLength, rx, rxLength);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transferSegments() / transferSegmentsOnPort()
+    //
+    // Generic versions: gather and scatter through buffers on the stack
+
+    bool QwIDeviceBus::transferSegments(uint8_t address, const QwWriteSegment *tx, uint8_t txCount, const QwReadSegment *rx,
+                                        uint8_t rxCount)
+    {
+        uint8_t txBuffer[SFE_PCA9846_I2C_BUFFER_LENGTH];
+        uint8_t rxBuffer[SFE_PCA9846_I2C_BUFFER_LENGTH];
+
+        return stagedTransfer(false, 0, 0, address, tx, txCount, rx, rxCount, txBuffer, rxBuffer, sizeof(txBuffer));
+    }
+
+    bool QwIDeviceBus::transferSegmentsOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const QwWriteSegment *tx,
+                                              uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount)
+    {
+        uint8_t txBuffer[SFE_PCA9846_I2C_BUFFER_LENGTH];
+        uint8_t rxBuffer[SFE_PCA9846_I2C_BUFFER_LENGTH];
+
+        return stagedTransfer(true, muxAddress, portBits, address, tx, txCount, rx, rxCount, txBuffer, rxBuffer, sizeof(txBuffer));
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // stagedTransfer()
+    //
+    // A single segment is passed straight through - only lists of two or more are copied
+
+    bool QwIDeviceBus::stagedTransfer(bool onPort, uint8_t muxAddress, uint8_t portBits, uint8_t address, const QwWriteSegment *tx,
+                                      uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount, uint8_t *txBuffer,
+                                      uint8_t *rxBuffer, uint16_t bufferSize)
+    {
+        uint32_t txLength = segmentsLength(tx, txCount);
+        uint32_t rxLength = segmentsLength(rx, rxCount);
+
+        if ((txLength > 0xFFFF) || (rxLength > 0xFFFF))
+            return false;
+        if (((txCount > 1) && (txLength > bufferSize)) || ((rxCount > 1) && (rxLength > bufferSize)))
+            return false;
+
+        const uint8_t *txData = (txCount == 1) ? tx[0].data : txBuffer;
+        uint8_t *rxData = (rxCount == 1) ? rx[0].data : rxBuffer;
+
+        if (txCount > 1)
+        {
+            uint8_t *next = txBuffer;
+            for (uint8_t i = 0; i < txCount; i++)
+            {
+                for (uint16_t j = 0; j < tx[i].length; j++)
+                    *next++ = tx[i].data[j];
+            }
+        }
+
+        bool success;
+        if (onPort)
+            success = transferOnPort(muxAddress, portBits, address, txData, (uint16_t)txLength, rxData, (uint16_t)rxLength);
+        else
+            success = transfer(address, txData, (uint16_t)txLength, rxData, (uint16_t)rxLength);
+
+        if (success && (rxCount > 1))
+        {
+            const uint8_t *next = rxBuffer;
+            for (uint8_t i = 0; i < rxCount; i++)
+            {
+                for (uint16_t j = 0; j < rx[i].length; j++)
+                    rx[i].data[j] = *next++;
+            }
+        }
+
+        return success;
+    }
+
+#if defined(ARDUINO)
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructor
+    //
+
+    QwI2C::QwI2C(void) : _i2cPort{nullptr}, _lastError{SFE_PCA9846_BUS_OK}
     {
     }
 
@@ -75,6 +290,133 @@ namespace sfe_PCA9846
             return false;
     }
 
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // endTransmission()
+    //
+    // End the transmission and record the result for getLastError()
+
+    bool QwI2C::endTransmission(bool stop)
+    {
+        _lastError = _i2cPort->endTransmission(stop);
+        return _lastError == SFE_PCA9846_BUS_OK;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // setClock()
+    //
+
+    bool QwI2C::setClock(uint32_t clockHz)
+    {
+        if (!_i2cPort)
+            return false;
+
+        _i2cPort->setClock(clockHz);
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transfer() / transferOnPort()
+    //
+    // One segment each way
+
+    bool QwI2C::transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength)
+    {
+        QwWriteSegment txSegment = {tx, txLength};
+        QwReadSegment rxSegment = {rx, rxLength};
+
+        return transferSegments(address, &txSegment, 1, &rxSegment, 1);
+    }
+
+    bool QwI2C::transferOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const uint8_t *tx, uint16_t txLength,
+                               uint8_t *rx, uint16_t rxLength)
+    {
+        QwWriteSegment txSegment = {tx, txLength};
+        QwReadSegment rxSegment = {rx, rxLength};
+
+        return transferSegmentsOnPort(muxAddress, portBits, address, &txSegment, 1, &rxSegment, 1);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transferSegments()
+    //
+    // Any length of write, then a repeated START and the read. Each part must fit the Wire buffer.
+    // The segments go straight into, and come straight out of, the Wire buffers.
+
+    bool QwI2C::transferSegments(uint8_t address, const QwWriteSegment *tx, uint8_t txCount, const QwReadSegment *rx,
+                                 uint8_t rxCount)
+    {
+        if (!_i2cPort)
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_NO_BUS;
+            return false;
+        }
+
+        uint32_t txLength = segmentsLength(tx, txCount);
+        uint32_t rxLength = segmentsLength(rx, rxCount);
+
+        if ((txLength > maxTransferLength()) || (rxLength > maxTransferLength()))
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_TOO_LONG;
+            return false;
+        }
+
+        if ((txLength > 0) || (rxLength == 0))
+        {
+            _i2cPort->beginTransmission(address);
+            for (uint8_t i = 0; i < txCount; i++)
+            {
+                if (tx[i].length > 0)
+                    _i2cPort->write(tx[i].data, (int)tx[i].length);
+            }
+            if (!endTransmission(rxLength == 0)) // Restart if there is a read to follow
+                return false;
+        }
+
+        if (rxLength == 0)
+            return true;
+
+        uint8_t nReturned = _i2cPort->requestFrom((int)address, (int)rxLength, (int)true);
+
+        // Check we received the correct number of bytes
+        if (nReturned != rxLength)
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_SHORT_READ;
+            return false;
+        }
+
+        _lastError = SFE_PCA9846_BUS_OK;
+
+        for (uint8_t i = 0; i < rxCount; i++)
+        {
+            for (uint16_t j = 0; j < rx[i].length; j++)
+                rx[i].data[j] = _i2cPort->read();
+        }
+
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transferSegmentsOnPort()
+    //
+    // The control write must end with a STOP: the mux connects the new ports then
+
+    bool QwI2C::transferSegmentsOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const QwWriteSegment *tx,
+                                       uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount)
+    {
+        if (!_i2cPort)
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_NO_BUS;
+            return false;
+        }
+
+        _i2cPort->beginTransmission(muxAddress);
+        _i2cPort->write(portBits);
+        if (!endTransmission())
+            return false;
+
+        return transferSegments(address, tx, txCount, rx, rxCount);
+    }
+
     //////////////////////////////////////////////////////////////////////////////////////////////////
     // ping()
     //
@@ -83,10 +425,13 @@ namespace sfe_PCA9846
     {
 
         if (!_i2cPort)
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_NO_BUS;
             return false;
+        }
 
         _i2cPort->beginTransmission(i2c_address);
-        return _i2cPort->endTransmission() == 0;
+        return endTransmission();
     }
 
     //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -98,11 +443,14 @@ namespace sfe_PCA9846
     {
 
         if (!_i2cPort)
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_NO_BUS;
             return false;
+        }
 
         _i2cPort->beginTransmission(i2c_address);
         _i2cPort->write(dataToWrite);
-        return _i2cPort->endTransmission() == 0;
+        return endTransmission();
     }
 
     //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -114,12 +462,15 @@ namespace sfe_PCA9846
     {
 
         if (!_i2cPort)
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_NO_BUS;
             return false;
+        }
 
         _i2cPort->beginTransmission(i2c_address);
         _i2cPort->write(offset);
         _i2cPort->write(dataToWrite);
-        return _i2cPort->endTransmission() == 0;
+        return endTransmission();
     }
 
     //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -130,13 +481,16 @@ namespace sfe_PCA9846
     bool QwI2C::writeRegisterRegion(uint8_t i2c_address, uint8_t offset, const uint8_t *data, uint16_t length)
     {
         if (!_i2cPort)
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_NO_BUS;
             return false;
+        }
 
         _i2cPort->beginTransmission(i2c_address);
         _i2cPort->write(offset);
         _i2cPort->write(data, (int)length);
 
-        return _i2cPort->endTransmission() == 0;
+        return endTransmission();
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -148,13 +502,21 @@ namespace sfe_PCA9846
     bool QwI2C::read(uint8_t address, uint8_t *data)
     {
         if (!_i2cPort)
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_NO_BUS;
             return false;
+        }
 
         uint8_t nReturned = _i2cPort->requestFrom((int)address, (int)1, (int)true);
 
         // Check we received the correct number of bytes
         if (nReturned != 1)
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_SHORT_READ;
             return false; // error
+        }
+
+        _lastError = SFE_PCA9846_BUS_OK;
 
         // Copy the retrieved data to the data segment
         *data = _i2cPort->read();
@@ -171,18 +533,24 @@ namespace sfe_PCA9846
     bool QwI2C::readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length)
     {
         if (!_i2cPort)
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_NO_BUS;
             return false;
+        }
 
         _i2cPort->beginTransmission(address);
         _i2cPort->write(offset);
-        if (_i2cPort->endTransmission(false) != 0) // Do a restart
+        if (!endTransmission(false)) // Do a restart
             return false; // error with the end transmission
 
         uint8_t nReturned = _i2cPort->requestFrom((int)address, (int)length, (int)true);
 
         // Check we received the correct number of bytes
         if (nReturned != length)
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_SHORT_READ;
             return false; // error
+        }
 
         // Copy the retrieved data to the data segment
         for (uint8_t i = 0; i < nReturned; i++)
@@ -191,4 +559,6 @@ namespace sfe_PCA9846
         return true; // Success
     }
 
+#endif
+
 }
@@ -29,11 +29,58 @@
 
 #pragma once
 
+#if defined(ARDUINO)
 #include "Arduino.h"
 #include <Wire.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+// Error codes reported by getLastError(). 1-5 are the Arduino endTransmission() codes
+#define SFE_PCA9846_BUS_OK 0
+#define SFE_PCA9846_BUS_ERROR_TOO_LONG 1   // Data too long to fit in the transmit buffer
+#define SFE_PCA9846_BUS_ERROR_ADDR_NACK 2  // NACK on transmit of the address
+#define SFE_PCA9846_BUS_ERROR_DATA_NACK 3  // NACK on transmit of data
+#define SFE_PCA9846_BUS_ERROR_OTHER 4      // Other error (bus error, arbitration lost, ...)
+#define SFE_PCA9846_BUS_ERROR_TIMEOUT 5    // Timeout
+#define SFE_PCA9846_BUS_ERROR_SHORT_READ 6 // Fewer bytes received than requested
+#define SFE_PCA9846_BUS_ERROR_NO_BUS 7     // The bus has not been initialized
+#define SFE_PCA9846_BUS_ERROR_COUNT 8
+
+// Size of the I2C buffer of the bus library. Transfers longer than this are split into chunks
+#ifndef SFE_PCA9846_I2C_BUFFER_LENGTH
+#if defined(I2C_BUFFER_LENGTH)
+#define SFE_PCA9846_I2C_BUFFER_LENGTH I2C_BUFFER_LENGTH
+#elif defined(BUFFER_LENGTH)
+#define SFE_PCA9846_I2C_BUFFER_LENGTH BUFFER_LENGTH
+#else
+#define SFE_PCA9846_I2C_BUFFER_LENGTH 32
+#endif
+#endif
 
 namespace sfe_PCA9846
 {
+    // Receives the data of a streamed read, one chunk at a time. Return false to stop the read
+    typedef bool (*QwReadSink)(const uint8_t *data, uint16_t length, void *context);
+
+    // One buffer of a scatter-gather transfer. The segments of a write go out back to back, and
+    // the bytes of a read are spread over its segments in order
+    struct QwWriteSegment
+    {
+        const uint8_t *data;
+        uint16_t length;
+    };
+
+    struct QwReadSegment
+    {
+        uint8_t *data;
+        uint16_t length;
+    };
+
+    // Total number of bytes in a list of segments
+    uint32_t segmentsLength(const QwWriteSegment *segments, uint8_t count);
+    uint32_t segmentsLength(const QwReadSegment *segments, uint8_t count);
 
     // The following abstract class is used an interface for upstream implementation.
     class QwIDeviceBus
@@ -50,8 +97,100 @@ namespace sfe_PCA9846
         virtual bool read(uint8_t address, uint8_t *data) = 0;
 
         virtual bool readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length) = 0;
+
+        // Why the last transfer failed. Buses which cannot tell report SFE_PCA9846_BUS_ERROR_OTHER
+        virtual uint8_t getLastError() { return SFE_PCA9846_BUS_ERROR_OTHER; }
+
+        // Longest transfer the bus can do in one go, in bytes, including the register offset
+        virtual uint16_t maxTransferLength() { return SFE_PCA9846_I2C_BUFFER_LENGTH; }
+
+        // Change the SCL frequency. Returns false if the bus does not support it
+        virtual bool setClock(uint32_t clockHz)
+        {
+            (void)clockHz;
+            return false;
+        }
+
+        //////////////////////////////////////////////////////////////////////////////////
+        // transfer()
+        //
+        // Write txLength bytes, then read rxLength bytes with a repeated START. Either
+        // part may be empty. The default implementation maps the common cases onto the
+        // calls above: tx only, a 1-byte register offset then rx, or a 1-byte rx on its
+        // own. Buses which can do more (e.g. a 2-byte register offset) override it.
+        //
+        //  Parameter    Description
+        //  ---------    -----------------------------
+        //  address      I2C address of the device
+        //  tx           Bytes to write. May be nullptr if txLength is 0
+        //  txLength     Number of bytes to write
+        //  rx           Buffer to read into. May be nullptr if rxLength is 0
+        //  rxLength     Number of bytes to read
+        //  retval       false = error or not supported by the bus, true = success
+
+        virtual bool transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength);
+
+        //////////////////////////////////////////////////////////////////////////////////
+        // transferOnPort()
+        //
+        // Write portBits to the mux control register, then transfer(). The mux connects
+        // the new ports at the STOP which ends the control write, so the two can not
+        // share a repeated START - but a bus may still send them back to back.
+        //
+        //  Parameter    Description
+        //  ---------    -----------------------------
+        //  muxAddress   I2C address of the mux
+        //  portBits     New control register value
+        //  (the rest)   As transfer()
+
+        virtual bool transferOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const uint8_t *tx, uint16_t txLength,
+                                    uint8_t *rx, uint16_t rxLength);
+
+        //////////////////////////////////////////////////////////////////////////////////
+        // transferSegments()
+        //
+        // As transfer(), but the bytes written are gathered from txCount segments and the
+        // bytes read are scattered over rxCount segments - e.g. a register offset and a
+        // payload written from two buffers, or one read split over several structs. It is
+        // still one I2C transaction. The default implementation copies through staging
+        // buffers of SFE_PCA9846_I2C_BUFFER_LENGTH bytes (none for a single segment each
+        // way); buses which can send segments directly override it.
+        //
+        //  Parameter    Description
+        //  ---------    -----------------------------
+        //  address      I2C address of the device
+        //  tx           Segments to write. May be nullptr if txCount is 0
+        //  txCount      Number of segments to write
+        //  rx           Segments to read into. May be nullptr if rxCount is 0
+        //  rxCount      Number of segments to read
+        //  retval       false = error or too long for the bus, true = success
+
+        virtual bool transferSegments(uint8_t address, const QwWriteSegment *tx, uint8_t txCount, const QwReadSegment *rx,
+                                      uint8_t rxCount);
+
+        // Write portBits to the mux control register, then transferSegments(). See transferOnPort()
+        virtual bool transferSegmentsOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const QwWriteSegment *tx,
+                                            uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount);
+
+        // Reads / writes of any length, split into chunks which fit maxTransferLength().
+        // autoIncrement: advance the register offset from chunk to chunk. Pass false for FIFOs
+        bool readRegisterRegionChunked(uint8_t address, uint8_t offset, uint8_t *data, uint32_t length, bool autoIncrement = true);
+
+        bool writeRegisterRegionChunked(uint8_t address, uint8_t offset, const uint8_t *data, uint32_t length, bool autoIncrement = true);
+
+        // Read length bytes, passing them to sink one chunk at a time, without a full-size buffer.
+        // autoIncrement as above: pass false for FIFOs
+        bool readRegisterStream(uint8_t address, uint8_t offset, uint32_t length, QwReadSink sink, void *context = nullptr, bool autoIncrement = true);
+
+    protected:
+        // Gather tx into txBuffer, run transfer() - or transferOnPort() if onPort - then scatter
+        // rxBuffer over rx. Both buffers are bufferSize bytes
+        bool stagedTransfer(bool onPort, uint8_t muxAddress, uint8_t portBits, uint8_t address, const QwWriteSegment *tx,
+                            uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount, uint8_t *txBuffer, uint8_t *rxBuffer,
+                            uint16_t bufferSize);
     };
 
+#if defined(ARDUINO)
     // The QwI2C device defines behavior for I2C implementation based around the TwoWire class (Wire).
     // This is Arduino specific.
     class QwI2C : public QwIDeviceBus
@@ -75,8 +214,27 @@ namespace sfe_PCA9846
 
         bool readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length);
 
+        uint8_t getLastError() { return _lastError; }
+
+        bool setClock(uint32_t clockHz);
+
+        bool transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength);
+
+        bool transferOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const uint8_t *tx, uint16_t txLength,
+                            uint8_t *rx, uint16_t rxLength);
+
+        bool transferSegments(uint8_t address, const QwWriteSegment *tx, uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount);
+
+        bool transferSegmentsOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const QwWriteSegment *tx, uint8_t txCount,
+                                    const QwReadSegment *rx, uint8_t rxCount);
+
     private:
+        // endTransmission(), recording the result in _lastError
+        bool endTransmission(bool stop = true);
+
         TwoWire *_i2cPort;
+        uint8_t _lastError;
     };
+#endif
 
 };
@@ -0,0 +1,213 @@
+// sfe_bus_stats.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Bus instrumentation. See sfe_bus_stats.h
+
+#include "sfe_bus_stats.h"
+#include <string.h>
+
+namespace sfe_PCA9846
+{
+
+#if defined(ARDUINO)
+    static uint32_t arduinoMicros(void)
+    {
+        return micros();
+    }
+#endif
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructor
+    //
+
+    QwInstrumentedBus::QwInstrumentedBus(QwIDeviceBus &bus, QwMicrosFunction microsFunction) : _bus{bus}, _micros{microsFunction}
+    {
+#if defined(ARDUINO)
+        if (!_micros)
+            _micros = arduinoMicros;
+#endif
+        resetStats();
+    }
+
+    void QwInstrumentedBus::resetStats()
+    {
+        memset(&_stats, 0, sizeof(_stats));
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // record()
+    //
+
+    void QwInstrumentedBus::record(QwBusOp op, bool success, uint32_t start)
+    {
+        _stats.count[op]++;
+
+        if (!success)
+        {
+            _stats.failures[op]++;
+
+            uint8_t error = _bus.getLastError();
+            if ((error == SFE_PCA9846_BUS_OK) || (error >= SFE_PCA9846_BUS_ERROR_COUNT))
+                error = SFE_PCA9846_BUS_ERROR_OTHER;
+            _stats.errors[error]++;
+        }
+
+        if (!_micros)
+            return;
+
+        uint32_t elapsed = now() - start;
+        _stats.totalMicros[op] += elapsed;
+
+        uint8_t bucket = 0;
+        uint32_t limit = SFE_PCA9846_STATS_BUCKET_0_US;
+        while ((bucket < SFE_PCA9846_STATS_BUCKETS - 1) && (elapsed >= limit))
+        {
+            bucket++;
+            limit <<= 1;
+        }
+
+        if (_stats.latency[op][bucket] < 0xFFFF)
+            _stats.latency[op][bucket]++;
+    }
+
+    bool QwInstrumentedBus::ping(uint8_t address)
+    {
+        uint32_t start = now();
+        bool success = _bus.ping(address);
+        record(kQwBusOpPing, success, start);
+        return success;
+    }
+
+    bool QwInstrumentedBus::write(uint8_t address, uint8_t data)
+    {
+        uint32_t start = now();
+        bool success = _bus.write(address, data);
+        record(kQwBusOpWrite, success, start);
+        if (success)
+            _stats.bytesWritten++;
+        return success;
+    }
+
+    bool QwInstrumentedBus::writeRegisterByte(uint8_t address, uint8_t offset, uint8_t data)
+    {
+        uint32_t start = now();
+        bool success = _bus.writeRegisterByte(address, offset, data);
+        record(kQwBusOpWriteRegisterRegion, success, start);
+        if (success)
+            _stats.bytesWritten++;
+        return success;
+    }
+
+    bool QwInstrumentedBus::writeRegisterRegion(uint8_t address, uint8_t offset, const uint8_t *data, uint16_t length)
+    {
+        uint32_t start = now();
+        bool success = _bus.writeRegisterRegion(address, offset, data, length);
+        record(kQwBusOpWriteRegisterRegion, success, start);
+        if (success)
+            _stats.bytesWritten += length;
+        return success;
+    }
+
+    bool QwInstrumentedBus::read(uint8_t address, uint8_t *data)
+    {
+        uint32_t start = now();
+        bool success = _bus.read(address, data);
+        record(kQwBusOpRead, success, start);
+        if (success)
+            _stats.bytesRead++;
+        return success;
+    }
+
+    bool QwInstrumentedBus::readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length)
+    {
+        uint32_t start = now();
+        bool success = _bus.readRegisterRegion(address, offset, data, length);
+        record(kQwBusOpReadRegisterRegion, success, start);
+        if (success)
+            _stats.bytesRead += length;
+        return success;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transfer() / transferOnPort() / transferSegments() / transferSegmentsOnPort()
+    //
+    // The bus can not tell register offsets from data here: every byte of tx counts as written
+
+    bool QwInstrumentedBus::transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength)
+    {
+        uint32_t start = now();
+        bool success = _bus.transfer(address, tx, txLength, rx, rxLength);
+        record(kQwBusOpTransfer, success, start);
+        if (success)
+        {
+            _stats.bytesWritten += txLength;
+            _stats.bytesRead += rxLength;
+        }
+        return success;
+    }
+
+    bool QwInstrumentedBus::transferOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const uint8_t *tx,
+                                           uint16_t txLength, uint8_t *rx, uint16_t rxLength)
+    {
+        uint32_t start = now();
+        bool success = _bus.transferOnPort(muxAddress, portBits, address, tx, txLength, rx, rxLength);
+        record(kQwBusOpTransfer, success, start);
+        if (success)
+        {
+            _stats.bytesWritten += 1 + txLength; // Including the control register write
+            _stats.bytesRead += rxLength;
+        }
+        return success;
+    }
+
+    bool QwInstrumentedBus::transferSegments(uint8_t address, const QwWriteSegment *tx, uint8_t txCount, const QwReadSegment *rx,
+                                             uint8_t rxCount)
+    {
+        uint32_t start = now();
+        bool success = _bus.transferSegments(address, tx, txCount, rx, rxCount);
+        record(kQwBusOpTransfer, success, start);
+        if (success)
+        {
+            _stats.bytesWritten += segmentsLength(tx, txCount);
+            _stats.bytesRead += segmentsLength(rx, rxCount);
+        }
+        return success;
+    }
+
+    bool QwInstrumentedBus::transferSegmentsOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const QwWriteSegment *tx,
+                                                   uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount)
+    {
+        uint32_t start = now();
+        bool success = _bus.transferSegmentsOnPort(muxAddress, portBits, address, tx, txCount, rx, rxCount);
+        record(kQwBusOpTransfer, success, start);
+        if (success)
+        {
+            _stats.bytesWritten += 1 + segmentsLength(tx, txCount);
+            _stats.bytesRead += segmentsLength(rx, rxCount);
+        }
+        return success;
+    }
+
+}
@@ -0,0 +1,131 @@
+// sfe_bus_stats.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwInstrumentedBus class wraps another QwIDeviceBus and records what goes
+// through it: a count of each operation, bytes moved, failures by error code,
+// and a latency histogram per operation. Wrap the bus given to
+// QwDevPCA9846::setCommunicationBus() to see the mux traffic, or the bus given
+// to a downstream driver to see that driver's traffic.
+//
+// Instrumentation is opt-in: code which does not wrap its bus pays nothing.
+// Latency needs a microsecond clock. On Arduino micros() is used by default;
+// elsewhere pass one to the constructor, or latency is not recorded.
+
+#pragma once
+
+#include "sfe_bus.h"
+
+// Latency bucket n counts transfers shorter than (SFE_PCA9846_STATS_BUCKET_0_US << n)
+// microseconds. The last bucket counts everything longer.
+#ifndef SFE_PCA9846_STATS_BUCKET_0_US
+#define SFE_PCA9846_STATS_BUCKET_0_US 32
+#endif
+
+#define SFE_PCA9846_STATS_BUCKETS 8
+
+namespace sfe_PCA9846
+{
+    // Operations, as counted by QwInstrumentedBus
+    enum QwBusOp
+    {
+        kQwBusOpPing = 0,            // ping()
+        kQwBusOpWrite,               // write()
+        kQwBusOpWriteRegisterRegion, // writeRegisterByte() and writeRegisterRegion()
+        kQwBusOpRead,                // read()
+        kQwBusOpReadRegisterRegion,  // readRegisterRegion()
+        kQwBusOpTransfer,            // transfer() and transferOnPort()
+        kQwBusOpCount
+    };
+
+    typedef uint32_t (*QwMicrosFunction)(void);
+
+    struct QwBusStats
+    {
+        uint32_t count[kQwBusOpCount];                              // Calls, per operation
+        uint32_t failures[kQwBusOpCount];                           // Failed calls, per operation
+        uint32_t bytesWritten;                                      // Data bytes written, excluding register offsets
+        uint32_t bytesRead;                                         // Data bytes read
+        uint32_t errors[SFE_PCA9846_BUS_ERROR_COUNT];               // Failed calls, per SFE_PCA9846_BUS_ERROR_ code
+        uint32_t totalMicros[kQwBusOpCount];                        // Time spent, per operation
+        uint16_t latency[kQwBusOpCount][SFE_PCA9846_STATS_BUCKETS]; // Histogram. Saturates at 65535
+    };
+
+    class QwInstrumentedBus : public QwIDeviceBus
+    {
+    public:
+        QwInstrumentedBus(QwIDeviceBus &bus, QwMicrosFunction microsFunction = nullptr);
+
+        //////////////////////////////////////////////////////////////////////////////////
+        // getStats()
+        //
+        // Copy the statistics gathered since the last resetStats()
+        //
+        //  Parameter    Description
+        //  ---------    -----------------------------
+        //  snapshot     Where to copy the statistics to
+
+        void getStats(QwBusStats &snapshot) { snapshot = _stats; }
+        void resetStats();
+
+        bool ping(uint8_t address);
+
+        bool write(uint8_t address, uint8_t data);
+
+        bool writeRegisterByte(uint8_t address, uint8_t offset, uint8_t data);
+
+        bool writeRegisterRegion(uint8_t address, uint8_t offset, const uint8_t *data, uint16_t length);
+
+        bool read(uint8_t address, uint8_t *data);
+
+        bool readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length);
+
+        uint8_t getLastError() { return _bus.getLastError(); }
+
+        uint16_t maxTransferLength() { return _bus.maxTransferLength(); }
+
+        bool setClock(uint32_t clockHz) { return _bus.setClock(clockHz); }
+
+        bool transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength);
+
+        bool transferOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const uint8_t *tx, uint16_t txLength,
+                            uint8_t *rx, uint16_t rxLength);
+
+        bool transferSegments(uint8_t address, const QwWriteSegment *tx, uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount);
+
+        bool transferSegmentsOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const QwWriteSegment *tx, uint8_t txCount,
+                                    const QwReadSegment *rx, uint8_t rxCount);
+
+    private:
+        uint32_t now() { return _micros ? _micros() : 0; }
+
+        // Record one completed operation which started at 'start'
+        void record(QwBusOp op, bool success, uint32_t start);
+
+        QwIDeviceBus &_bus;
+        QwMicrosFunction _micros;
+        QwBusStats _stats;
+    };
+
+};
@@ -0,0 +1,433 @@
+// sfe_bus_trace.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Bus trace recording. See sfe_bus_trace.h
+
+#include "sfe_bus_trace.h"
+#include <string.h>
+
+namespace sfe_PCA9846
+{
+
+#if defined(ARDUINO)
+    static uint32_t arduinoMicros(void)
+    {
+        return micros();
+    }
+#endif
+
+    // Largest record header: 3 bytes plus four varints
+    static const uint8_t kMaxHeader = 3 + 5 + 3 + 3 + 3;
+
+    static uint8_t putVarint(uint8_t *out, uint32_t value)
+    {
+        uint8_t length = 0;
+
+        while (value >= 0x80)
+        {
+            out[length++] = (uint8_t)(value | 0x80);
+            value >>= 7;
+        }
+        out[length++] = (uint8_t)value;
+
+        return length;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructor
+    //
+
+    QwTraceBus::QwTraceBus(QwIDeviceBus &bus, uint8_t *buffer, uint32_t size, QwMicrosFunction microsFunction)
+        : _bus{bus}, _micros{microsFunction}, _buffer{buffer}, _size{buffer ? size : 0}, _enabled{true},
+          _payloadLimit{SFE_PCA9846_TRACE_DEFAULT_PAYLOAD}
+    {
+#if defined(ARDUINO)
+        if (!_micros)
+            _micros = arduinoMicros;
+#endif
+        clear();
+    }
+
+    void QwTraceBus::clear()
+    {
+        _head = 0;
+        _tail = 0;
+        _used = 0;
+        _lastStart = now();
+        _records = 0;
+        _dropped = 0;
+        _recorderMicros = 0;
+    }
+
+    void QwTraceBus::putByte(uint8_t value)
+    {
+        _buffer[_head] = value;
+        if (++_head == _size)
+            _head = 0;
+    }
+
+    uint8_t QwTraceBus::getByte(uint32_t position)
+    {
+        return _buffer[position % _size];
+    }
+
+    uint32_t QwTraceBus::getVarint(uint32_t &position)
+    {
+        uint32_t value = 0;
+        uint8_t shift = 0;
+        uint8_t byte;
+
+        do
+        {
+            byte = getByte(position++);
+            value |= (uint32_t)(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        return value;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // dropOldest()
+    //
+    // Walk the header of the oldest record to find its size: without truncation, the payload is
+    // the length plus (for a transfer) the bytes read
+
+    void QwTraceBus::dropOldest()
+    {
+        uint32_t position = _tail;
+        uint8_t first = getByte(position);
+        position += 3;
+
+        getVarint(position); // Time delta
+        uint32_t stored = getVarint(position);
+        if ((first & 0x0F) == kQwTraceTransfer)
+            stored += getVarint(position);
+        if (first & 0x80)
+            stored = getVarint(position);
+
+        uint32_t recordSize = (position - _tail) + stored;
+
+        _tail = (_tail + recordSize) % _size;
+        _used -= recordSize;
+        _records--;
+        _dropped++;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // record()
+    //
+    // The data of failed reads is not stored - it is whatever was in the buffer
+
+    void QwTraceBus::record(uint8_t op, bool success, uint32_t start, uint8_t address, uint8_t offset, const uint8_t *data,
+                            uint16_t length, const uint8_t *data2, uint16_t rxLength)
+    {
+        QwWriteSegment txSegment = {data, length};
+        QwReadSegment rxSegment = {(uint8_t *)data2, rxLength};
+
+        record(op, success, start, address, offset, &txSegment, 1, &rxSegment, 1);
+    }
+
+    void QwTraceBus::record(uint8_t op, bool success, uint32_t start, uint8_t address, uint8_t offset, const QwWriteSegment *tx,
+                            uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount)
+    {
+        if (!_enabled || (_size == 0))
+            return;
+
+        uint32_t recordStart = now();
+
+        uint16_t length = (uint16_t)segmentsLength(tx, txCount);
+        uint16_t rxLength = (uint16_t)segmentsLength(rx, rxCount);
+
+        bool isRead = (op == kQwTraceRead) || (op == kQwTraceReadRegisterRegion);
+        uint16_t available1 = (isRead && !success) ? 0 : length;
+        uint16_t available2 = success ? rxLength : 0;
+
+        uint16_t stored1 = (available1 < _payloadLimit) ? available1 : _payloadLimit;
+        uint16_t stored2 = (available2 < (uint16_t)(_payloadLimit - stored1)) ? available2 : (uint16_t)(_payloadLimit - stored1);
+        uint32_t stored = (uint32_t)stored1 + stored2;
+        bool truncated = stored < ((uint32_t)length + rxLength);
+
+        uint8_t status = SFE_PCA9846_BUS_OK;
+        if (!success)
+        {
+            status = _bus.getLastError();
+            if ((status == SFE_PCA9846_BUS_OK) || (status > 7))
+                status = SFE_PCA9846_BUS_ERROR_OTHER;
+        }
+
+        uint8_t header[kMaxHeader];
+        uint8_t headerLength = 0;
+
+        header[headerLength++] = (uint8_t)(op | (status << 4) | (truncated ? 0x80 : 0));
+        header[headerLength++] = address;
+        header[headerLength++] = offset;
+        headerLength += putVarint(header + headerLength, start - _lastStart);
+        headerLength += putVarint(header + headerLength, length);
+        if (op == kQwTraceTransfer)
+            headerLength += putVarint(header + headerLength, rxLength);
+        if (truncated)
+            headerLength += putVarint(header + headerLength, stored);
+
+        _lastStart = start;
+
+        uint32_t recordSize = headerLength + stored;
+
+        if (recordSize > _size)
+        {
+            _dropped++;
+        }
+        else
+        {
+            while (_size - _used < recordSize)
+                dropOldest();
+
+            for (uint8_t i = 0; i < headerLength; i++)
+                putByte(header[i]);
+            for (uint8_t i = 0; (i < txCount) && (stored1 > 0); i++)
+            {
+                for (uint16_t j = 0; (j < tx[i].length) && (stored1 > 0); j++, stored1--)
+                    putByte(tx[i].data[j]);
+            }
+            for (uint8_t i = 0; (i < rxCount) && (stored2 > 0); i++)
+            {
+                for (uint16_t j = 0; (j < rx[i].length) && (stored2 > 0); j++, stored2--)
+                    putByte(rx[i].data[j]);
+            }
+
+            _used += recordSize;
+            _records++;
+        }
+
+        if (_micros)
+            _recorderMicros += now() - recordStart;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // exportTrace()
+    //
+
+    uint32_t QwTraceBus::exportTrace(uint8_t *out, uint32_t size)
+    {
+        if (size < _used + SFE_PCA9846_TRACE_HEADER_SIZE)
+            return 0;
+
+        out[0] = SFE_PCA9846_TRACE_MAGIC;
+        out[1] = SFE_PCA9846_TRACE_VERSION;
+
+        // The records may wrap round the end of the ring
+        uint32_t first = _size - _tail;
+        if (first > _used)
+            first = _used;
+
+        if (first > 0)
+            memcpy(out + SFE_PCA9846_TRACE_HEADER_SIZE, _buffer + _tail, first);
+        if (_used > first)
+            memcpy(out + SFE_PCA9846_TRACE_HEADER_SIZE + first, _buffer, _used - first);
+
+        return _used + SFE_PCA9846_TRACE_HEADER_SIZE;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // The traced operations
+    //
+
+    bool QwTraceBus::ping(uint8_t address)
+    {
+        uint32_t start = now();
+        bool success = _bus.ping(address);
+        record(kQwTracePing, success, start, address, 0, nullptr, 0);
+        return success;
+    }
+
+    bool QwTraceBus::write(uint8_t address, uint8_t data)
+    {
+        uint32_t start = now();
+        bool success = _bus.write(address, data);
+        record(kQwTraceWrite, success, start, address, 0, &data, 1);
+        return success;
+    }
+
+    bool QwTraceBus::writeRegisterByte(uint8_t address, uint8_t offset, uint8_t data)
+    {
+        uint32_t start = now();
+        bool success = _bus.writeRegisterByte(address, offset, data);
+        record(kQwTraceWriteRegisterRegion, success, start, address, offset, &data, 1);
+        return success;
+    }
+
+    bool QwTraceBus::writeRegisterRegion(uint8_t address, uint8_t offset, const uint8_t *data, uint16_t length)
+    {
+        uint32_t start = now();
+        bool success = _bus.writeRegisterRegion(address, offset, data, length);
+        record(kQwTraceWriteRegisterRegion, success, start, address, offset, data, length);
+        return success;
+    }
+
+    bool QwTraceBus::read(uint8_t address, uint8_t *data)
+    {
+        uint32_t start = now();
+        bool success = _bus.read(address, data);
+        record(kQwTraceRead, success, start, address, 0, data, 1);
+        return success;
+    }
+
+    bool QwTraceBus::readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length)
+    {
+        uint32_t start = now();
+        bool success = _bus.readRegisterRegion(address, offset, data, length);
+        record(kQwTraceReadRegisterRegion, success, start, address, offset, data, length);
+        return success;
+    }
+
+    bool QwTraceBus::setClock(uint32_t clockHz)
+    {
+        uint32_t start = now();
+        bool success = _bus.setClock(clockHz);
+
+        uint8_t payload[4] = {(uint8_t)clockHz, (uint8_t)(clockHz >> 8), (uint8_t)(clockHz >> 16), (uint8_t)(clockHz >> 24)};
+        record(kQwTraceSetClock, success, start, 0, 0, payload, sizeof(payload));
+        return success;
+    }
+
+    bool QwTraceBus::transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength)
+    {
+        uint32_t start = now();
+        bool success = _bus.transfer(address, tx, txLength, rx, rxLength);
+        record(kQwTraceTransfer, success, start, address, 0, tx, txLength, rx, rxLength);
+        return success;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transferOnPort()
+    //
+    // The underlying bus still gets the combined call. If it fails, the trace can not tell which
+    // half failed: the control write is recorded as good and the transfer as failed.
+
+    bool QwTraceBus::transferOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const uint8_t *tx, uint16_t txLength,
+                                    uint8_t *rx, uint16_t rxLength)
+    {
+        uint32_t start = now();
+        bool success = _bus.transferOnPort(muxAddress, portBits, address, tx, txLength, rx, rxLength);
+        record(kQwTraceWrite, true, start, muxAddress, 0, &portBits, 1);
+        record(kQwTraceTransfer, success, start, address, 0, tx, txLength, rx, rxLength);
+        return success;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transferSegments() / transferSegmentsOnPort()
+    //
+    // Recorded as transfer() / transferOnPort(): the trace holds the bytes, not how they were split
+
+    bool QwTraceBus::transferSegments(uint8_t address, const QwWriteSegment *tx, uint8_t txCount, const QwReadSegment *rx,
+                                      uint8_t rxCount)
+    {
+        uint32_t start = now();
+        bool success = _bus.transferSegments(address, tx, txCount, rx, rxCount);
+        record(kQwTraceTransfer, success, start, address, 0, tx, txCount, rx, rxCount);
+        return success;
+    }
+
+    bool QwTraceBus::transferSegmentsOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const QwWriteSegment *tx,
+                                            uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount)
+    {
+        uint32_t start = now();
+        bool success = _bus.transferSegmentsOnPort(muxAddress, portBits, address, tx, txCount, rx, rxCount);
+        record(kQwTraceWrite, true, start, muxAddress, 0, &portBits, 1);
+        record(kQwTraceTransfer, success, start, address, 0, tx, txCount, rx, rxCount);
+        return success;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // QwTraceReader
+    //
+
+    QwTraceReader::QwTraceReader(const uint8_t *trace, uint32_t size) : _trace{trace}, _size{size}, _position{SFE_PCA9846_TRACE_HEADER_SIZE}
+    {
+        _valid = trace && (size >= SFE_PCA9846_TRACE_HEADER_SIZE) && (trace[0] == SFE_PCA9846_TRACE_MAGIC) &&
+                 (trace[1] == SFE_PCA9846_TRACE_VERSION);
+    }
+
+    bool QwTraceReader::getVarint(uint32_t &value)
+    {
+        value = 0;
+
+        for (uint8_t shift = 0; shift < 35; shift += 7)
+        {
+            if (_position >= _size)
+                return false;
+
+            uint8_t byte = _trace[_position++];
+            value |= (uint32_t)(byte & 0x7F) << shift;
+
+            if (!(byte & 0x80))
+                return true;
+        }
+
+        return false;
+    }
+
+    bool QwTraceReader::next(QwTraceRecord &record)
+    {
+        if (!_valid || (_position + 3 > _size))
+            return false;
+
+        uint8_t first = _trace[_position];
+        record.op = first & 0x0F;
+        record.status = (first >> 4) & 0x07;
+        record.truncated = (first & 0x80) != 0;
+        record.address = _trace[_position + 1];
+        record.offset = _trace[_position + 2];
+        _position += 3;
+
+        if (record.op >= kQwTraceOpCount)
+            return false;
+
+        uint32_t length = 0;
+        uint32_t rxLength = 0;
+
+        if (!getVarint(record.deltaMicros) || !getVarint(length))
+            return false;
+
+        if ((record.op == kQwTraceTransfer) && !getVarint(rxLength))
+            return false;
+
+        uint32_t stored = length + rxLength;
+        if (record.truncated && !getVarint(stored))
+            return false;
+
+        if ((length > 0xFFFF) || (rxLength > 0xFFFF) || (stored > length + rxLength) || (_position + stored > _size))
+            return false;
+
+        record.length = (uint16_t)length;
+        record.rxLength = (uint16_t)rxLength;
+        record.payloadLength = (uint16_t)stored;
+        record.payload = _trace + _position;
+        _position += stored;
+
+        return true;
+    }
+
+}
@@ -0,0 +1,239 @@
+// sfe_bus_trace.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwTraceBus class wraps another QwIDeviceBus and records every transfer
+// into a fixed-size ring buffer supplied by the application. When the buffer is
+// full, the oldest records are dropped. exportTrace() copies the trace out
+// (over Serial, to flash, ...) and QwTraceReader reads it back, on the device or
+// on a host. See also QwPCA9846TraceReplayer, which runs a trace again.
+//
+// Record format - every multi-byte number is an unsigned LEB128 varint:
+//
+//  byte     bits 0-3 QwTraceOp, bits 4-6 status (SFE_PCA9846_BUS_ error code),
+//           bit 7 set if the payload is truncated
+//  byte     I2C address
+//  byte     register offset (0 if the operation has none)
+//  varint   microseconds since the previous record started
+//  varint   length: bytes written or read (transfer: bytes written)
+//  varint   transfer only: bytes read
+//  varint   truncated only: payload bytes stored
+//  bytes    payload: the data written or read (transfer: written, then read).
+//           The data of failed reads is not stored
+//
+// A ping with no time source costs 5 bytes; a 2-byte register read, 7.
+
+#pragma once
+
+#include "sfe_bus.h"
+#include "sfe_bus_stats.h"
+
+// Payload bytes stored per record, unless changed with setPayloadLimit()
+#ifndef SFE_PCA9846_TRACE_DEFAULT_PAYLOAD
+#define SFE_PCA9846_TRACE_DEFAULT_PAYLOAD 32
+#endif
+
+// exportTrace() header: magic byte and format version
+#define SFE_PCA9846_TRACE_MAGIC 0x54 // 'T'
+#define SFE_PCA9846_TRACE_VERSION 1
+#define SFE_PCA9846_TRACE_HEADER_SIZE 2
+
+namespace sfe_PCA9846
+{
+    enum QwTraceOp
+    {
+        kQwTracePing = 0,
+        kQwTraceWrite,              // write()
+        kQwTraceWriteRegisterRegion, // writeRegisterByte() and writeRegisterRegion()
+        kQwTraceRead,               // read()
+        kQwTraceReadRegisterRegion, // readRegisterRegion()
+        kQwTraceTransfer,           // transfer()
+        kQwTraceSetClock,           // setClock(). Payload: the frequency, 4 bytes little-endian
+        kQwTraceOpCount
+    };
+
+    // One record, as decoded by QwTraceReader
+    struct QwTraceRecord
+    {
+        uint8_t op;             // QwTraceOp
+        uint8_t status;         // SFE_PCA9846_BUS_OK or an error code
+        uint8_t address;
+        uint8_t offset;
+        uint32_t deltaMicros;   // Since the previous record started
+        uint16_t length;        // Bytes written or read (transfer: written)
+        uint16_t rxLength;      // Transfer: bytes read. Otherwise 0
+        uint16_t payloadLength; // Bytes of payload stored
+        const uint8_t *payload; // Points into the trace
+        bool truncated;         // payloadLength is less than the data moved
+    };
+
+    class QwTraceBus : public QwIDeviceBus
+    {
+    public:
+        //////////////////////////////////////////////////////////////////////////////////
+        // Constructor
+        //
+        //  Parameter      Description
+        //  ---------      -----------------------------
+        //  bus            The bus to trace
+        //  buffer         Ring buffer for the records
+        //  size           Size of the buffer
+        //  microsFunction Time source. micros() by default on Arduino. Without one, deltas are 0
+
+        QwTraceBus(QwIDeviceBus &bus, uint8_t *buffer, uint32_t size, QwMicrosFunction microsFunction = nullptr);
+
+        // Recording can be paused. The bus works as normal either way
+        void enable(bool enable = true) { _enabled = enable; }
+        bool isEnabled() { return _enabled; }
+
+        void setPayloadLimit(uint16_t limit) { _payloadLimit = limit; }
+
+        void clear();
+
+        uint32_t getRecords() { return _records; }       // Records in the buffer
+        uint32_t getBytesUsed() { return _used; }        // Bytes of buffer in use
+        uint32_t getDropped() { return _dropped; }       // Old records dropped to make room, and records too big to fit
+        uint32_t getRecorderMicros() { return _recorderMicros; } // Time spent recording (needs a time source)
+
+        //////////////////////////////////////////////////////////////////////////////////
+        // exportTrace()
+        //
+        // Copy the trace out, oldest record first, behind a 2-byte header.
+        //
+        //  Parameter    Description
+        //  ---------    -----------------------------
+        //  out          Destination
+        //  size         Size of the destination. getBytesUsed() + SFE_PCA9846_TRACE_HEADER_SIZE is enough
+        //  retval       Bytes copied. 0 if the destination is too small
+
+        uint32_t exportTrace(uint8_t *out, uint32_t size);
+
+        bool ping(uint8_t address);
+
+        bool write(uint8_t address, uint8_t data);
+
+        bool writeRegisterByte(uint8_t address, uint8_t offset, uint8_t data);
+
+        bool writeRegisterRegion(uint8_t address, uint8_t offset, const uint8_t *data, uint16_t length);
+
+        bool read(uint8_t address, uint8_t *data);
+
+        bool readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length);
+
+        uint8_t getLastError() { return _bus.getLastError(); }
+
+        uint16_t maxTransferLength() { return _bus.maxTransferLength(); }
+
+        bool setClock(uint32_t clockHz);
+
+        bool transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength);
+
+        // Recorded as a write() to the mux followed by a transfer()
+        bool transferOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const uint8_t *tx, uint16_t txLength,
+                            uint8_t *rx, uint16_t rxLength);
+
+        // Recorded as a transfer() / transferOnPort() of the same bytes
+        bool transferSegments(uint8_t address, const QwWriteSegment *tx, uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount);
+
+        bool transferSegmentsOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const QwWriteSegment *tx, uint8_t txCount,
+                                    const QwReadSegment *rx, uint8_t rxCount);
+
+    private:
+        uint32_t now() { return _micros ? _micros() : 0; }
+
+        //////////////////////////////////////////////////////////////////////////////////
+        // record()
+        //
+        //  Parameter    Description
+        //  ---------    -----------------------------
+        //  op           QwTraceOp
+        //  success      Result of the operation
+        //  start        now() when the operation started
+        //  address      I2C address
+        //  offset       Register offset
+        //  data, length The data written or read
+        //  data2, rxLength Transfer only: the data read
+
+        void record(uint8_t op, bool success, uint32_t start, uint8_t address, uint8_t offset, const uint8_t *data, uint16_t length,
+                    const uint8_t *data2 = nullptr, uint16_t rxLength = 0);
+
+        // The same, with the data written and read in segments
+        void record(uint8_t op, bool success, uint32_t start, uint8_t address, uint8_t offset, const QwWriteSegment *tx, uint8_t txCount,
+                    const QwReadSegment *rx, uint8_t rxCount);
+
+        void putByte(uint8_t value);
+        uint8_t getByte(uint32_t position);
+
+        // Decode a varint from the ring, advancing position
+        uint32_t getVarint(uint32_t &position);
+
+        // Remove the oldest record
+        void dropOldest();
+
+        QwIDeviceBus &_bus;
+        QwMicrosFunction _micros;
+
+        uint8_t *_buffer;
+        uint32_t _size;
+        uint32_t _head; // Next byte to write
+        uint32_t _tail; // Oldest record
+        uint32_t _used;
+
+        bool _enabled;
+        uint16_t _payloadLimit;
+        uint32_t _lastStart;
+
+        uint32_t _records;
+        uint32_t _dropped;
+        uint32_t _recorderMicros;
+    };
+
+    // Reads an exported trace, one record at a time
+    class QwTraceReader
+    {
+    public:
+        QwTraceReader(const uint8_t *trace, uint32_t size);
+
+        // The header is present and the version is known
+        bool isValid() { return _valid; }
+
+        // Next record. Returns false at the end of the trace, or if it is corrupt
+        bool next(QwTraceRecord &record);
+
+        // Back to the first record
+        void rewind() { _position = SFE_PCA9846_TRACE_HEADER_SIZE; }
+
+        // Every record has been read
+        bool atEnd() { return _valid && (_position == _size); }
+
+    private:
+        bool getVarint(uint32_t &value);
+
+        const uint8_t *_trace;
+        uint32_t _size;
+        uint32_t _position;
+        bool _valid;
+    };
+
+};
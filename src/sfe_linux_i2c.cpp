@@ -0,0 +1,455 @@
+// sfe_linux_i2c.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// QwIDeviceBus on Linux i2c-dev. See sfe_linux_i2c.h
+
+#include "sfe_linux_i2c.h"
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace sfe_PCA9846
+{
+
+    static int systemIoctl(int fd, unsigned long request, void *argument)
+    {
+        return ioctl(fd, request, argument);
+    }
+
+    static uint8_t nonEmptySegments(const QwReadSegment *segments, uint8_t count)
+    {
+        uint8_t nonEmpty = 0;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (segments[i].length > 0)
+                nonEmpty++;
+        }
+        return nonEmpty;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructor
+    //
+
+    QwLinuxI2C::QwLinuxI2C(void)
+        : _fd{-1}, _ownFd{false}, _ioctl{systemIoctl}, _functions{0}, _ioctls{0}, _lastErrno{0}, _lastError{SFE_PCA9846_BUS_OK}
+    {
+    }
+
+    QwLinuxI2C::~QwLinuxI2C()
+    {
+        end();
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // init()
+    //
+
+    bool QwLinuxI2C::init(uint8_t busNumber)
+    {
+        char devicePath[20];
+        snprintf(devicePath, sizeof(devicePath), "/dev/i2c-%u", (unsigned)busNumber);
+
+        return init(devicePath);
+    }
+
+    bool QwLinuxI2C::init(const char *devicePath)
+    {
+        end();
+
+        int fd = open(devicePath, O_RDWR);
+        if (fd < 0)
+        {
+            _lastErrno = errno;
+            _lastError = SFE_PCA9846_BUS_ERROR_NO_BUS;
+            return false;
+        }
+
+        if (!attach(fd))
+        {
+            close(fd);
+            return false;
+        }
+
+        _ownFd = true;
+        return true;
+    }
+
+    bool QwLinuxI2C::attach(int fd)
+    {
+        end();
+
+        unsigned long functions = 0;
+        _ioctls++;
+        if (_ioctl(fd, I2C_FUNCS, &functions) < 0)
+        {
+            _lastErrno = errno;
+            _lastError = SFE_PCA9846_BUS_ERROR_NO_BUS;
+            return false;
+        }
+
+        // I2C_RDWR needs a plain I2C adapter, not an SMBus-only one
+        if (!(functions & I2C_FUNC_I2C))
+        {
+            _lastErrno = EOPNOTSUPP;
+            _lastError = SFE_PCA9846_BUS_ERROR_NO_BUS;
+            return false;
+        }
+
+        _fd = fd;
+        _ownFd = false;
+        _functions = functions;
+        return true;
+    }
+
+    void QwLinuxI2C::end()
+    {
+        if (_ownFd && (_fd >= 0))
+            close(_fd);
+
+        _fd = -1;
+        _ownFd = false;
+        _functions = 0;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // rdwr()
+    //
+    // errno to SFE_PCA9846_BUS_ERROR_ code, following the kernel's i2c fault codes
+
+    bool QwLinuxI2C::rdwr(void *messages, uint32_t numMessages)
+    {
+        if (_fd < 0)
+        {
+            _lastErrno = EBADF;
+            _lastError = SFE_PCA9846_BUS_ERROR_NO_BUS;
+            return false;
+        }
+
+        struct i2c_rdwr_ioctl_data request;
+        request.msgs = (struct i2c_msg *)messages;
+        request.nmsgs = numMessages;
+
+        _ioctls++;
+        if (_ioctl(_fd, I2C_RDWR, &request) >= 0)
+        {
+            _lastErrno = 0;
+            _lastError = SFE_PCA9846_BUS_OK;
+            return true;
+        }
+
+        _lastErrno = errno;
+
+        switch (_lastErrno)
+        {
+        case ENXIO:
+            _lastError = SFE_PCA9846_BUS_ERROR_ADDR_NACK;
+            break;
+        case EREMOTEIO:
+            _lastError = SFE_PCA9846_BUS_ERROR_DATA_NACK;
+            break;
+        case ETIMEDOUT:
+            _lastError = SFE_PCA9846_BUS_ERROR_TIMEOUT;
+            break;
+        default:
+            _lastError = SFE_PCA9846_BUS_ERROR_OTHER;
+            break;
+        }
+
+        return false;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // ping()
+    //
+    // A zero-length write: the address byte and nothing else
+
+    bool QwLinuxI2C::ping(uint8_t address)
+    {
+        struct i2c_msg message = {address, 0, 0, nullptr};
+
+        return rdwr(&message, 1);
+    }
+
+    bool QwLinuxI2C::write(uint8_t address, uint8_t data)
+    {
+        struct i2c_msg message = {address, 0, 1, &data};
+
+        return rdwr(&message, 1);
+    }
+
+    bool QwLinuxI2C::writeRegisterByte(uint8_t address, uint8_t offset, uint8_t data)
+    {
+        return writeRegisterRegion(address, offset, &data, 1);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // writeRegisterRegion()
+    //
+    // The offset and the data must be one message, so they are copied together
+
+    bool QwLinuxI2C::writeRegisterRegion(uint8_t address, uint8_t offset, const uint8_t *data, uint16_t length)
+    {
+        uint8_t buffer[SFE_PCA9846_LINUX_I2C_MAX_TRANSFER];
+
+        if (length >= sizeof(buffer))
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_TOO_LONG;
+            return false;
+        }
+
+        buffer[0] = offset;
+        if (length > 0)
+            memcpy(buffer + 1, data, length);
+
+        struct i2c_msg message = {address, 0, (uint16_t)(1 + length), buffer};
+
+        return rdwr(&message, 1);
+    }
+
+    bool QwLinuxI2C::read(uint8_t address, uint8_t *data)
+    {
+        struct i2c_msg message = {address, I2C_M_RD, 1, data};
+
+        return rdwr(&message, 1);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // readRegisterRegion()
+    //
+    // Pointer write and read in one ioctl, with a repeated START between them
+
+    bool QwLinuxI2C::readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length)
+    {
+        struct i2c_msg messages[2] = {{address, 0, 1, &offset}, {address, I2C_M_RD, length, data}};
+
+        return rdwr(messages, 2);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transfer()
+    //
+
+    bool QwLinuxI2C::transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength)
+    {
+        struct i2c_msg messages[2];
+        uint32_t numMessages = 0;
+
+        if ((txLength > 0) || (rxLength == 0))
+            messages[numMessages++] = {address, 0, txLength, (uint8_t *)tx};
+
+        if (rxLength > 0)
+            messages[numMessages++] = {address, I2C_M_RD, rxLength, rx};
+
+        return rdwr(messages, numMessages);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transferOnPort()
+    //
+    // One ioctl if the adapter can STOP after the control write, two if not
+
+    bool QwLinuxI2C::transferOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const uint8_t *tx, uint16_t txLength,
+                                    uint8_t *rx, uint16_t rxLength)
+    {
+        if (!canStopBetweenMessages())
+        {
+            if (!write(muxAddress, portBits))
+                return false;
+
+            return transfer(address, tx, txLength, rx, rxLength);
+        }
+
+        struct i2c_msg messages[3];
+        uint32_t numMessages = 0;
+
+        messages[numMessages++] = {muxAddress, I2C_M_STOP, 1, &portBits};
+
+        if ((txLength > 0) || (rxLength == 0))
+            messages[numMessages++] = {address, 0, txLength, (uint8_t *)tx};
+
+        if (rxLength > 0)
+            messages[numMessages++] = {address, I2C_M_RD, rxLength, rx};
+
+        return rdwr(messages, numMessages);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // segmentMessages()
+    //
+    // Only writes are joined with I2C_M_NOSTART. A read continued that way has no repeated START,
+    // but many adapters do not support it, and those which ignore the flag NACK the last byte of
+    // each segment, ending the read early. So reads go out as one message.
+
+    uint32_t QwLinuxI2C::segmentMessages(void *messages, uint32_t numMessages, uint8_t address, const QwWriteSegment *tx,
+                                         uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount, uint8_t *rxBuffer)
+    {
+        struct i2c_msg *message = (struct i2c_msg *)messages;
+        uint32_t start = numMessages;
+
+        for (uint8_t i = 0; i < txCount; i++)
+        {
+            if (tx[i].length == 0)
+                continue;
+
+            uint16_t flags = (numMessages == start) ? 0 : I2C_M_NOSTART;
+            message[numMessages++] = {address, flags, tx[i].length, (uint8_t *)tx[i].data};
+        }
+
+        uint32_t rxLength = segmentsLength(rx, rxCount);
+
+        // Nothing either way is a ping
+        if ((numMessages == start) && (rxLength == 0))
+            message[numMessages++] = {address, 0, 0, nullptr};
+
+        if (rxLength == 0)
+            return numMessages;
+
+        uint8_t *rxData = rxBuffer;
+        if (nonEmptySegments(rx, rxCount) == 1)
+        {
+            for (uint8_t i = 0; i < rxCount; i++)
+            {
+                if (rx[i].length > 0)
+                    rxData = rx[i].data;
+            }
+        }
+        else if (rxLength > SFE_PCA9846_LINUX_I2C_MAX_TRANSFER)
+        {
+            return 0;
+        }
+
+        message[numMessages++] = {address, I2C_M_RD, (uint16_t)rxLength, rxData};
+
+        return numMessages;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // rdwrSegments()
+    //
+
+    bool QwLinuxI2C::rdwrSegments(void *messages, uint32_t numMessages, const QwReadSegment *rx, uint8_t rxCount,
+                                  const uint8_t *rxBuffer)
+    {
+        if (numMessages == 0)
+        {
+            _lastError = SFE_PCA9846_BUS_ERROR_TOO_LONG;
+            return false;
+        }
+
+        if (!rdwr(messages, numMessages))
+            return false;
+
+        if (nonEmptySegments(rx, rxCount) > 1)
+        {
+            for (uint8_t i = 0; i < rxCount; i++)
+            {
+                for (uint16_t j = 0; j < rx[i].length; j++)
+                    rx[i].data[j] = *rxBuffer++;
+            }
+        }
+
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transferSegments()
+    //
+    // Without I2C_FUNC_NOSTART - or with more write segments than fit - copy into one message each way
+
+    bool QwLinuxI2C::transferSegments(uint8_t address, const QwWriteSegment *tx, uint8_t txCount, const QwReadSegment *rx,
+                                      uint8_t rxCount)
+    {
+        if (!canJoinMessages() || (txCount >= SFE_PCA9846_LINUX_I2C_MAX_SEGMENTS))
+        {
+            uint8_t txBuffer[SFE_PCA9846_LINUX_I2C_MAX_TRANSFER];
+            uint8_t rxBuffer[SFE_PCA9846_LINUX_I2C_MAX_TRANSFER];
+
+            if (!stagedTransfer(false, 0, 0, address, tx, txCount, rx, rxCount, txBuffer, rxBuffer, sizeof(txBuffer)))
+            {
+                if (_lastError == SFE_PCA9846_BUS_OK)
+                    _lastError = SFE_PCA9846_BUS_ERROR_TOO_LONG;
+                return false;
+            }
+            return true;
+        }
+
+        struct i2c_msg messages[SFE_PCA9846_LINUX_I2C_MAX_SEGMENTS];
+        uint8_t rxBuffer[SFE_PCA9846_LINUX_I2C_MAX_TRANSFER];
+
+        uint32_t numMessages = segmentMessages(messages, 0, address, tx, txCount, rx, rxCount, rxBuffer);
+        return rdwrSegments(messages, numMessages, rx, rxCount, rxBuffer);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transferSegmentsOnPort()
+    //
+    // As transferOnPort(): one ioctl if the adapter can STOP after the control write
+
+    bool QwLinuxI2C::transferSegmentsOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const QwWriteSegment *tx,
+                                            uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount)
+    {
+        if (!canStopBetweenMessages())
+        {
+            if (!write(muxAddress, portBits))
+                return false;
+
+            return transferSegments(address, tx, txCount, rx, rxCount);
+        }
+
+        if (!canJoinMessages() || (txCount >= SFE_PCA9846_LINUX_I2C_MAX_SEGMENTS))
+        {
+            uint8_t txBuffer[SFE_PCA9846_LINUX_I2C_MAX_TRANSFER];
+            uint8_t rxBuffer[SFE_PCA9846_LINUX_I2C_MAX_TRANSFER];
+
+            if (!stagedTransfer(true, muxAddress, portBits, address, tx, txCount, rx, rxCount, txBuffer, rxBuffer, sizeof(txBuffer)))
+            {
+                if (_lastError == SFE_PCA9846_BUS_OK)
+                    _lastError = SFE_PCA9846_BUS_ERROR_TOO_LONG;
+                return false;
+            }
+            return true;
+        }
+
+        struct i2c_msg messages[1 + SFE_PCA9846_LINUX_I2C_MAX_SEGMENTS];
+        uint8_t rxBuffer[SFE_PCA9846_LINUX_I2C_MAX_TRANSFER];
+
+        messages[0] = {muxAddress, I2C_M_STOP, 1, &portBits};
+
+        uint32_t numMessages = segmentMessages(messages, 1, address, tx, txCount, rx, rxCount, rxBuffer);
+        return rdwrSegments(messages, numMessages, rx, rxCount, rxBuffer);
+    }
+
+}
+
+#endif
@@ -0,0 +1,168 @@
+// sfe_linux_i2c.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwLinuxI2C class implements QwIDeviceBus on a Linux i2c-dev bus
+// (/dev/i2c-N), for running the mux from a single board computer.
+//
+// Every operation is one I2C_RDWR ioctl. A register read - pointer write plus
+// read - goes out as two messages joined by a repeated START. transferOnPort()
+// adds the mux control write as a third message. The mux only connects the new
+// port at a STOP, so this needs an adapter with I2C_FUNC_PROTOCOL_MANGLING to
+// put a STOP (I2C_M_STOP) after the control write. Without it, the control
+// write is sent as an ioctl of its own.
+//
+// transferSegments() sends each write segment as a message of its own, joined
+// to the one before by I2C_M_NOSTART, so nothing is copied. That needs an
+// adapter with I2C_FUNC_NOSTART; without it, the segments are copied into one
+// message. The read segments are always read as one message, and copied out to
+// the segments afterwards when there is more than one.
+//
+// Errors come back as errno: ENXIO is an address NACK, EREMOTEIO a data NACK.
+// Not every adapter driver tells the two apart - some, such as bcm2835 on the
+// Raspberry Pi, report an address NACK as EREMOTEIO - so there getLastError()
+// returns SFE_PCA9846_BUS_ERROR_DATA_NACK for both, and the short test of
+// QwPCA9846ProductionTest, which expects an address NACK, fails every port.
+//
+// The ioctl can be replaced (setIoctlFunction()), so the class can be tested
+// without I2C hardware. Alternatively, load the i2c-stub module.
+
+#pragma once
+
+#include "sfe_bus.h"
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+// Largest single message: the register offset plus the data
+#ifndef SFE_PCA9846_LINUX_I2C_MAX_TRANSFER
+#define SFE_PCA9846_LINUX_I2C_MAX_TRANSFER 256
+#endif
+
+// Most messages in a transferSegments() ioctl: one per write segment, plus one for the read
+#ifndef SFE_PCA9846_LINUX_I2C_MAX_SEGMENTS
+#define SFE_PCA9846_LINUX_I2C_MAX_SEGMENTS 16
+#endif
+
+namespace sfe_PCA9846
+{
+    // Same signature as ioctl(2), for the requests used here
+    typedef int (*QwIoctlFunction)(int fd, unsigned long request, void *argument);
+
+    class QwLinuxI2C : public QwIDeviceBus
+    {
+    public:
+        QwLinuxI2C(void);
+        ~QwLinuxI2C();
+
+        //////////////////////////////////////////////////////////////////////////////////
+        // init()
+        //
+        // Open an i2c-dev bus and read the adapter's functionality.
+        //
+        //  Parameter    Description
+        //  ---------    -----------------------------
+        //  busNumber    N in /dev/i2c-N
+        //  devicePath   Or the full path of the device node
+        //  retval       false = error (see getLastErrno()), true = success
+
+        bool init(uint8_t busNumber);
+        bool init(const char *devicePath);
+
+        // Use a file descriptor opened elsewhere. It is not closed by end()
+        bool attach(int fd);
+
+        void end();
+
+        // Replace ioctl(2), e.g. with a test shim. Call before init() / attach()
+        void setIoctlFunction(QwIoctlFunction ioctlFunction) { _ioctl = ioctlFunction; }
+
+        // The adapter can put a STOP between messages of one ioctl (I2C_FUNC_PROTOCOL_MANGLING)
+        bool canStopBetweenMessages() { return (_functions & kFuncProtocolMangling) != 0; }
+
+        // The adapter can continue a message without a START and address (I2C_FUNC_NOSTART)
+        bool canJoinMessages() { return (_functions & kFuncNoStart) != 0; }
+
+        // Number of ioctl calls made
+        uint32_t getIoctls() { return _ioctls; }
+
+        // errno of the last failure
+        int getLastErrno() { return _lastErrno; }
+
+        bool ping(uint8_t address);
+
+        bool write(uint8_t address, uint8_t data);
+
+        bool writeRegisterByte(uint8_t address, uint8_t offset, uint8_t data);
+
+        bool writeRegisterRegion(uint8_t address, uint8_t offset, const uint8_t *data, uint16_t length);
+
+        bool read(uint8_t address, uint8_t *data);
+
+        bool readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length);
+
+        uint8_t getLastError() { return _lastError; }
+
+        uint16_t maxTransferLength() { return SFE_PCA9846_LINUX_I2C_MAX_TRANSFER; }
+
+        bool transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength);
+
+        bool transferOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const uint8_t *tx, uint16_t txLength,
+                            uint8_t *rx, uint16_t rxLength);
+
+        bool transferSegments(uint8_t address, const QwWriteSegment *tx, uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount);
+
+        bool transferSegmentsOnPort(uint8_t muxAddress, uint8_t portBits, uint8_t address, const QwWriteSegment *tx, uint8_t txCount,
+                                    const QwReadSegment *rx, uint8_t rxCount);
+
+    private:
+        // I2C_FUNC_PROTOCOL_MANGLING and I2C_FUNC_NOSTART, without pulling <linux/i2c.h> into the header
+        static const unsigned long kFuncProtocolMangling = 0x00000004;
+        static const unsigned long kFuncNoStart = 0x00000010;
+
+        // Append one struct i2c_msg per non-empty write segment to messages, the segments after
+        // the first joined with I2C_M_NOSTART, then one read message for all the read segments.
+        // With more than one read segment, that reads into rxBuffer. Returns the new number of
+        // messages, or 0 if the reads do not fit rxBuffer
+        uint32_t segmentMessages(void *messages, uint32_t numMessages, uint8_t address, const QwWriteSegment *tx, uint8_t txCount,
+                                 const QwReadSegment *rx, uint8_t rxCount, uint8_t *rxBuffer);
+
+        // Send the messages, then copy rxBuffer out to the read segments, if it was used
+        bool rdwrSegments(void *messages, uint32_t numMessages, const QwReadSegment *rx, uint8_t rxCount, const uint8_t *rxBuffer);
+
+        // Send numMessages struct i2c_msg in one I2C_RDWR ioctl
+        bool rdwr(void *messages, uint32_t numMessages);
+
+        int _fd;
+        bool _ownFd;
+        QwIoctlFunction _ioctl;
+        unsigned long _functions;
+
+        uint32_t _ioctls;
+        int _lastErrno;
+        uint8_t _lastError;
+    };
+
+};
+
+#endif
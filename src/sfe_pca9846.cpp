@@ -13,6 +13,7 @@
 */
 
 #include "sfe_pca9846.h"
+#include <string.h>
 
 //////////////////////////////////////////////////////////////////////////////
 // init()
@@ -32,6 +33,8 @@ bool QwDevPCA9846::init(void)
     if (getUniqueId() != SFE_PCA9846_MUX_DEVICE_ID)
         return false;
 
+    _idVerified = _idCacheEnabled;
+
     return true;
 }
 
@@ -47,12 +50,45 @@ bool QwDevPCA9846::init(void)
 
 bool QwDevPCA9846::isConnected()
 {
-    if (getUniqueId() != SFE_PCA9846_MUX_DEVICE_ID)
+    uint8_t portBits;
+
+    switch (_verifyLevel)
+    {
+    case kQwVerifyPing:
+        break;
+
+    case kQwVerifyControlRead:
+        return read(&portBits); // Refreshes the shadow copy too
+
+    default:
+        // A remembered Device ID check only needs the mux to still be there
+        if (!_idVerified)
+        {
+            if (getUniqueId() != SFE_PCA9846_MUX_DEVICE_ID)
+                return false;
+
+            _idVerified = _idCacheEnabled;
+            return true;
+        }
+        break;
+    }
+
+    if (!_sfeBus->ping(_i2cAddress))
+    {
+        invalidateCache();
         return false;
+    }
 
     return true;
 }
 
+// Remember successful Device ID checks
+void QwDevPCA9846::enableIdCache(bool enable)
+{
+    _idCacheEnabled = enable;
+    _idVerified = false;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // getUniqueId()
 //
@@ -66,7 +102,10 @@ uint32_t QwDevPCA9846::getUniqueId()
     bool retVal = _sfeBus->readRegisterRegion(SFE_PCA9846_MUX_DEVICE_ID_ADDRESS, _i2cAddress << 1, chipID, 3);
 
     if (!retVal)
+    {
+        invalidateCache();
         return 0;
+    }
 
     uint32_t ID = ((uint32_t)chipID[0]) << 16;
     ID |= ((uint32_t)chipID[1]) << 8;
@@ -117,7 +156,8 @@ void QwDevPCA9846::setCommunicationBus(sfe_PCA9846::QwIDeviceBus &theBus)
 
 bool QwDevPCA9846::write(uint8_t data)
 {
-    return _sfeBus->write(_i2cAddress, data);
+    // The mux has a single control register, so a plain write sets the port state
+    return setPortState(data);
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -133,7 +173,10 @@ bool QwDevPCA9846::write(uint8_t data)
 
 bool QwDevPCA9846::writeRegisterRegion(uint8_t offset, uint8_t *data, uint16_t length)
 {
-    return _sfeBus->writeRegisterRegion(_i2cAddress, offset, data, length);
+    // Every byte written to the mux lands in the control register
+    invalidateCache();
+
+    return _sfeBus->writeRegisterRegionChunked(_i2cAddress, offset, data, length);
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -147,7 +190,17 @@ bool QwDevPCA9846::writeRegisterRegion(uint8_t offset, uint8_t *data, uint16_t l
 
 bool QwDevPCA9846::read(uint8_t *data)
 {
-    return _sfeBus->read(_i2cAddress, data);
+    bool retVal = _sfeBus->read(_i2cAddress, data);
+
+    if (!retVal)
+        invalidateCache();
+    else if (_cacheEnabled)
+    {
+        _portCache = *data;
+        _cacheValid = true;
+    }
+
+    return retVal;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -163,7 +216,10 @@ bool QwDevPCA9846::read(uint8_t *data)
 
 bool QwDevPCA9846::readRegisterRegion(uint8_t offset, uint8_t *data, uint16_t length)
 {
-    return _sfeBus->readRegisterRegion(_i2cAddress, offset, data, length);
+    // The offset is written to the control register
+    invalidateCache();
+
+    return _sfeBus->readRegisterRegionChunked(_i2cAddress, offset, data, length);
 }
 
 // Enables one port. Disables all others.
@@ -177,7 +233,7 @@ bool QwDevPCA9846::setPort(uint8_t portNumber)
     else
         portValue = 1 << portNumber;
 
-    return _sfeBus->write(_i2cAddress, portValue);
+    return setPortState(portValue);
 }
 
 // Returns the first port number bit that is set
@@ -186,9 +242,8 @@ bool QwDevPCA9846::setPort(uint8_t portNumber)
 uint8_t QwDevPCA9846::getPort()
 {
     // Read the current mux settings
-    uint8_t portBits;
-    bool retVal = _sfeBus->read(_i2cAddress, &portBits);
-    if (!retVal)
+    uint8_t portBits = getPortState();
+    if (portBits == 254)
         return 254;
 
     // Search for the first set bit, then return its location
@@ -203,19 +258,225 @@ uint8_t QwDevPCA9846::getPort()
 // Writes a 4-bit value to mux
 // Overwrites any other bits
 // This allows us to enable/disable multiple ports at same time
+// If the cache is enabled and already holds portBits, the write is skipped
 bool QwDevPCA9846::setPortState(uint8_t portBits)
 {
-    return _sfeBus->write(_i2cAddress, portBits);
+    if (portBits & _isolatedPorts)
+        return false;
+
+    if (_cacheValid && _portCache == portBits)
+        return true;
+
+    prepareClock(portBits);
+
+    if (!_sfeBus->write(_i2cAddress, portBits))
+    {
+        invalidateCache();
+        return false;
+    }
+
+    completeClock(portBits);
+
+    if (_cacheEnabled)
+    {
+        _portCache = portBits;
+        _cacheValid = true;
+    }
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// transferOnPort()
+//
+
+bool QwDevPCA9846::transferOnPort(uint8_t portNumber, uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx,
+                                  uint16_t rxLength)
+{
+    sfe_PCA9846::QwWriteSegment txSegment = {tx, txLength};
+    sfe_PCA9846::QwReadSegment rxSegment = {rx, rxLength};
+
+    return transferSegmentsOnPort(portNumber, address, &txSegment, 1, &rxSegment, 1);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// transferSegmentsOnPort()
+//
+// Clock profiles may need the clock changed between the select and the transfer, so then the
+// select goes through setPortState() on its own.
+
+bool QwDevPCA9846::transferSegmentsOnPort(uint8_t portNumber, uint8_t address, const sfe_PCA9846::QwWriteSegment *tx,
+                                          uint8_t txCount, const sfe_PCA9846::QwReadSegment *rx, uint8_t rxCount)
+{
+    if (portNumber > 3)
+        return false;
+
+    uint8_t portBits = 1 << portNumber;
+
+    if (portBits & _isolatedPorts)
+        return false;
+
+    if ((_cacheValid && (_portCache == portBits)) || _clockProfiles)
+    {
+        if (!setPortState(portBits))
+            return false;
+
+        return _sfeBus->transferSegments(address, tx, txCount, rx, rxCount);
+    }
+
+    if (!_sfeBus->transferSegmentsOnPort(_i2cAddress, portBits, address, tx, txCount, rx, rxCount))
+    {
+        // The select may or may not have happened
+        invalidateCache();
+        return false;
+    }
+
+    if (_cacheEnabled)
+    {
+        _portCache = portBits;
+        _cacheValid = true;
+    }
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Clock profiles
+//
+
+bool QwDevPCA9846::setPortClock(uint8_t portNumber, uint32_t clockHz)
+{
+    if (portNumber > 3)
+        return false;
+
+    _portClock[portNumber] = clockHz;
+
+    _clockProfiles = false;
+    for (uint8_t port = 0; port < 4; port++)
+    {
+        if (_portClock[port])
+            _clockProfiles = true;
+    }
+
+    return true;
+}
+
+uint32_t QwDevPCA9846::requiredClock(uint8_t portBits)
+{
+    uint32_t clockHz = 0;
+
+    for (uint8_t port = 0; port < 4; port++)
+    {
+        if (!(portBits & (1 << port)))
+            continue;
+
+        uint32_t portClock = _portClock[port] ? _portClock[port] : _defaultClock;
+        if ((clockHz == 0) || (portClock < clockHz))
+            clockHz = portClock;
+    }
+
+    return clockHz ? clockHz : _defaultClock;
+}
+
+uint32_t QwDevPCA9846::slowestClock()
+{
+    uint32_t allPorts = requiredClock(0x0F);
+    return allPorts < _defaultClock ? allPorts : _defaultClock;
+}
+
+void QwDevPCA9846::setBusClock(uint32_t clockHz)
+{
+    if (clockHz == _currentClock)
+        return;
+
+    _currentClock = _sfeBus->setClock(clockHz) ? clockHz : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// prepareClock() / completeClock()
+//
+// The ports connected now stay connected until the write completes, so the write must suit them
+// as well: slow down before the write, speed up after it
+
+void QwDevPCA9846::prepareClock(uint8_t portBits)
+{
+    if (!_clockProfiles)
+        return;
+
+    uint32_t newClock = requiredClock(portBits);
+    uint32_t writeClock = _currentClock ? _currentClock : slowestClock();
+    setBusClock(newClock < writeClock ? newClock : writeClock);
+}
+
+void QwDevPCA9846::completeClock(uint8_t portBits)
+{
+    if (_clockProfiles)
+        setBusClock(requiredClock(portBits));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// probePortClock()
+//
+
+uint32_t QwDevPCA9846::probePortClock(uint8_t portNumber, uint8_t address, const uint32_t *candidates,
+                                      uint8_t numCandidates, uint8_t trials)
+{
+    static const uint32_t defaultCandidates[] = {1000000, 400000, 100000};
+
+    if (portNumber > 3)
+        return 0;
+
+    if (!candidates || (numCandidates == 0))
+    {
+        candidates = defaultCandidates;
+        numCandidates = sizeof(defaultCandidates) / sizeof(defaultCandidates[0]);
+    }
+
+    uint8_t previous = getPortState(); // 254 if it could not be read
+    uint32_t chosen = 0;
+
+    // Select the port on its own at the current settings, then step the clock down
+    if (setPortState(1 << portNumber))
+    {
+        for (uint8_t i = 0; (i < numCandidates) && (chosen == 0); i++)
+        {
+            setBusClock(candidates[i]);
+
+            bool reliable = true;
+            for (uint8_t trial = 0; (trial < trials) && reliable; trial++)
+            {
+                uint8_t data;
+                reliable = _sfeBus->ping(address) && _sfeBus->read(address, &data);
+            }
+
+            if (reliable)
+                chosen = candidates[i];
+        }
+    }
+
+    setPortClock(portNumber, chosen);
+
+    // Back to the previous selection, at the clock it needs. If that is unknown, disconnect everything
+    if (previous == 254)
+        previous = 0;
+
+    setPortState(previous);
+    setBusClock(requiredClock(previous));
+
+    return chosen;
 }
 
 // Gets the current port state
 // Returns byte that may have multiple bits set
 // Return 254 if there is an I2C error
+// If the cache is enabled and valid, the bus is not accessed
 uint8_t QwDevPCA9846::getPortState()
 {
+    if (_cacheValid)
+        return _portCache;
+
     uint8_t portBits;
-    bool retVal = _sfeBus->read(_i2cAddress, &portBits);
-    if (!retVal)
+    if (!read(&portBits))
         return 254;
     return portBits;
 }
@@ -256,3 +517,397 @@ bool QwDevPCA9846::disablePort(uint8_t portNumber)
 
     return (setPortState(settings));
 }
+
+// Enables / disables the shadow copy of the control register
+void QwDevPCA9846::enableCache(bool enable)
+{
+    _cacheEnabled = enable;
+    invalidateCache();
+}
+
+// Forgets the shadow copy of the control register, and any remembered Device ID check
+void QwDevPCA9846::invalidateCache()
+{
+    _cacheValid = false;
+    _idVerified = false;
+}
+
+// Re-reads the control register and refreshes the shadow copy
+bool QwDevPCA9846::resync()
+{
+    invalidateCache();
+
+    uint8_t portBits;
+    return read(&portBits);
+}
+
+// Returns the shadow copy, if it is valid
+bool QwDevPCA9846::getCachedPortState(uint8_t &portBits)
+{
+    if (_cacheValid)
+        portBits = _portCache;
+
+    return _cacheValid;
+}
+
+// Updates the shadow copy after the control register was changed through another path
+void QwDevPCA9846::setCachedPortState(uint8_t portBits)
+{
+    if (!_cacheEnabled)
+        return;
+
+    _portCache = portBits;
+    _cacheValid = true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Topology discovery
+//
+
+// Addresses 0x08-0x77: everything but the reserved addresses
+static const uint32_t defaultAddressMask[4] = {0xFFFFFF00, 0xFFFFFFFF, 0xFFFFFFFF, 0x00FFFFFF};
+
+void QwPCA9846Topology::clear()
+{
+    for (uint8_t bus = 0; bus < SFE_PCA9846_TOPOLOGY_BUSES; bus++)
+    {
+        for (uint8_t word = 0; word < 4; word++)
+            present[bus][word] = 0;
+    }
+
+    scanned = 0;
+    errors = 0;
+    dirty = 0;
+}
+
+// Layout: 'P', version, scanned, errors, 16 bytes per scanned bus (little endian words), checksum
+uint16_t QwPCA9846Topology::serialize(uint8_t *buffer, uint16_t size) const
+{
+    uint16_t length = 0;
+
+    if (size < 5)
+        return 0;
+
+    buffer[length++] = 'P';
+    buffer[length++] = 1;
+    buffer[length++] = scanned;
+    buffer[length++] = errors;
+
+    for (uint8_t bus = 0; bus < SFE_PCA9846_TOPOLOGY_BUSES; bus++)
+    {
+        if (!(scanned & (1 << bus)))
+            continue;
+
+        if (length + 16 + 1 > size)
+            return 0;
+
+        for (uint8_t word = 0; word < 4; word++)
+        {
+            for (uint8_t i = 0; i < 4; i++)
+                buffer[length++] = (uint8_t)(present[bus][word] >> (8 * i));
+        }
+    }
+
+    uint8_t checksum = 0;
+    for (uint16_t i = 0; i < length; i++)
+        checksum += buffer[i];
+    buffer[length++] = ~checksum;
+
+    return length;
+}
+
+bool QwPCA9846Topology::deserialize(const uint8_t *buffer, uint16_t size)
+{
+    if ((size < 5) || (buffer[0] != 'P') || (buffer[1] != 1))
+        return false;
+
+    uint8_t checksum = 0;
+    for (uint16_t i = 0; i < size - 1; i++)
+        checksum += buffer[i];
+    if (buffer[size - 1] != (uint8_t)~checksum)
+        return false;
+
+    uint8_t buses = buffer[2] & ((1 << SFE_PCA9846_TOPOLOGY_BUSES) - 1);
+    uint16_t expected = 5;
+    for (uint8_t bus = 0; bus < SFE_PCA9846_TOPOLOGY_BUSES; bus++)
+    {
+        if (buses & (1 << bus))
+            expected += 16;
+    }
+    if (size != expected)
+        return false;
+
+    clear();
+    scanned = buses;
+    errors = buffer[3] & buses;
+
+    uint16_t index = 4;
+    for (uint8_t bus = 0; bus < SFE_PCA9846_TOPOLOGY_BUSES; bus++)
+    {
+        if (!(buses & (1 << bus)))
+            continue;
+
+        for (uint8_t word = 0; word < 4; word++)
+        {
+            uint32_t value = 0;
+            for (uint8_t i = 0; i < 4; i++)
+                value |= ((uint32_t)buffer[index++]) << (8 * i);
+            present[bus][word] = value;
+        }
+    }
+
+    return true;
+}
+
+// Connects a single port, or (SFE_PCA9846_TOPOLOGY_UPSTREAM) disconnects them all
+bool QwDevPCA9846::selectBus(uint8_t bus)
+{
+    return setPortState(bus == SFE_PCA9846_TOPOLOGY_UPSTREAM ? 0 : 1 << bus);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// discover()
+//
+// Only timeouts and failures to reach the mux count as bus errors - a NACK just means
+// nobody is there
+
+bool QwDevPCA9846::discover(QwPCA9846Topology &topology, uint8_t portMask, const uint32_t *addressMask)
+{
+    if (!addressMask)
+        addressMask = defaultAddressMask;
+
+    portMask &= (1 << SFE_PCA9846_TOPOLOGY_BUSES) - 1;
+
+    uint8_t previous = getPortState();
+    bool success = true;
+
+    // Scan order: the bus which is already connected, then the upstream bus (so that its
+    // devices can be left out of the port results), then the ports in order
+    uint8_t order[SFE_PCA9846_TOPOLOGY_BUSES];
+    uint8_t numBuses = 0;
+
+    for (uint8_t bus = 0; bus < SFE_PCA9846_TOPOLOGY_BUSES; bus++)
+    {
+        if ((portMask & (1 << bus)) && (previous == (bus == SFE_PCA9846_TOPOLOGY_UPSTREAM ? 0 : 1 << bus)))
+            order[numBuses++] = bus;
+    }
+    if ((portMask & (1 << SFE_PCA9846_TOPOLOGY_UPSTREAM)) && ((numBuses == 0) || (order[0] != SFE_PCA9846_TOPOLOGY_UPSTREAM)))
+        order[numBuses++] = SFE_PCA9846_TOPOLOGY_UPSTREAM;
+    for (uint8_t bus = 0; bus < 4; bus++)
+    {
+        if ((portMask & (1 << bus)) && ((numBuses == 0) || (order[0] != bus)))
+            order[numBuses++] = bus;
+    }
+
+    for (uint8_t i = 0; i < numBuses; i++)
+    {
+        uint8_t bus = order[i];
+        uint8_t busBit = 1 << bus;
+
+        for (uint8_t word = 0; word < 4; word++)
+            topology.present[bus][word] = 0;
+        topology.errors &= ~busBit;
+        topology.dirty &= ~busBit;
+
+        if (!selectBus(bus))
+        {
+            topology.errors |= busBit;
+            success = false;
+            continue;
+        }
+
+        for (uint8_t address = 0; address < 128; address++)
+        {
+            if (!((addressMask[address >> 5] >> (address & 31)) & 1))
+                continue;
+
+            if (bus != SFE_PCA9846_TOPOLOGY_UPSTREAM)
+            {
+                if ((address == _i2cAddress) || (address == SFE_PCA9846_MUX_DEVICE_ID_ADDRESS))
+                    continue;
+
+                // Visible on every port - it is on the upstream bus
+                if (((topology.scanned >> SFE_PCA9846_TOPOLOGY_UPSTREAM) & 1) && topology.isPresent(SFE_PCA9846_TOPOLOGY_UPSTREAM, address))
+                    continue;
+            }
+
+            if (_sfeBus->ping(address))
+            {
+                topology.present[bus][address >> 5] |= 1UL << (address & 31);
+            }
+            else
+            {
+                uint8_t error = _sfeBus->getLastError();
+                if ((error == SFE_PCA9846_BUS_ERROR_TIMEOUT) || (error == SFE_PCA9846_BUS_ERROR_NO_BUS))
+                {
+                    topology.errors |= busBit;
+                    success = false;
+                }
+            }
+        }
+
+        topology.scanned |= busBit;
+    }
+
+    // Ports scanned before the upstream bus may list upstream devices too
+    if ((topology.scanned >> SFE_PCA9846_TOPOLOGY_UPSTREAM) & 1)
+    {
+        for (uint8_t bus = 0; bus < 4; bus++)
+        {
+            if (!(portMask & (1 << bus)))
+                continue;
+
+            for (uint8_t word = 0; word < 4; word++)
+                topology.present[bus][word] &= ~topology.present[SFE_PCA9846_TOPOLOGY_UPSTREAM][word];
+        }
+    }
+
+    // Put the mux back the way it was
+    if (previous != 254)
+    {
+        if (!setPortState(previous))
+            success = false;
+    }
+
+    return success;
+}
+
+bool QwDevPCA9846::rescan(QwPCA9846Topology &topology, const uint32_t *addressMask)
+{
+    uint8_t all = (1 << SFE_PCA9846_TOPOLOGY_BUSES) - 1;
+    uint8_t buses = (topology.dirty | topology.errors | ~topology.scanned) & all;
+
+    if (buses == 0)
+        return true;
+
+    return discover(topology, buses, addressMask);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// validateTopology()
+//
+
+bool QwDevPCA9846::validateTopology(QwPCA9846Topology &topology)
+{
+    uint8_t previous = getPortState();
+    bool valid = true;
+
+    for (uint8_t bus = 0; bus < SFE_PCA9846_TOPOLOGY_BUSES; bus++)
+    {
+        uint8_t busBit = 1 << bus;
+
+        if (!(topology.scanned & busBit))
+            continue;
+
+        bool selected = false;
+
+        for (uint8_t address = 0; address < 128; address++)
+        {
+            if (!topology.isPresent(bus, address))
+                continue;
+
+            // Only switch to buses which have something to check
+            if (!selected)
+            {
+                if (!selectBus(bus))
+                {
+                    topology.dirty |= busBit;
+                    valid = false;
+                    break;
+                }
+                selected = true;
+            }
+
+            if (!_sfeBus->ping(address))
+            {
+                topology.dirty |= busBit;
+                valid = false;
+                break;
+            }
+        }
+    }
+
+    if (previous != 254)
+        setPortState(previous);
+
+    return valid;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// broadcastWrite()
+//
+// A write with several ports enabled reaches every device at the address; the ACK only
+// shows that at least one of them answered, which is what the read back is for
+
+bool QwDevPCA9846::broadcastWrite(uint8_t portMask, uint8_t address, const QwPCA9846RegisterWrite *writes, uint8_t numWrites,
+                                  bool verify, uint8_t *failedPorts)
+{
+    portMask &= 0x0F;
+
+    if (failedPorts)
+        *failedPorts = 0;
+
+    uint8_t previous = getPortState();
+    bool success = setPortState(portMask);
+
+    for (uint8_t i = 0; success && (i < numWrites); i++)
+        success = _sfeBus->writeRegisterRegionChunked(address, writes[i].reg, writes[i].data, writes[i].length);
+
+    if (!success)
+    {
+        if (failedPorts)
+            *failedPorts = portMask;
+    }
+    else if (verify)
+    {
+        for (uint8_t port = 0; port < 4; port++)
+        {
+            if (!(portMask & (1 << port)))
+                continue;
+
+            bool matched = setPort(port);
+
+            for (uint8_t i = 0; matched && (i < numWrites); i++)
+            {
+                uint8_t readBack[SFE_PCA9846_I2C_BUFFER_LENGTH];
+                uint16_t done = 0;
+
+                while (matched && (done < writes[i].length))
+                {
+                    uint16_t chunk = writes[i].length - done;
+                    if (chunk > sizeof(readBack))
+                        chunk = sizeof(readBack);
+                    if (chunk > 0xFF)
+                        chunk = 0xFF;
+
+                    matched = _sfeBus->readRegisterRegion(address, writes[i].reg + done, readBack, (uint8_t)chunk) &&
+                              (memcmp(readBack, writes[i].data + done, chunk) == 0);
+                    done += chunk;
+                }
+            }
+
+            if (!matched)
+            {
+                success = false;
+                if (failedPorts)
+                    *failedPorts |= 1 << port;
+            }
+        }
+    }
+
+    // Put the mux back the way it was
+    if (previous != 254)
+    {
+        if (!setPortState(previous))
+            success = false;
+    }
+
+    return success;
+}
+
+bool QwDevPCA9846::broadcastWriteRegion(uint8_t portMask, uint8_t address, uint8_t reg, const uint8_t *data, uint16_t length,
+                                        bool verify, uint8_t *failedPorts)
+{
+    QwPCA9846RegisterWrite write = {reg, data, length};
+    return broadcastWrite(portMask, address, &write, 1, verify, failedPorts);
+}
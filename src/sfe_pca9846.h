@@ -20,10 +20,69 @@
 #define SFE_PCA9846_MUX_DEVICE_ID_ADDRESS 0x7C // Unshifted
 #define SFE_PCA9846_MUX_DEVICE_ID 0x000858
 
+#define SFE_PCA9846_DEFAULT_CLOCK 100000 // Used by ports without a clock profile
+
+// How much work isConnected() does
+enum QwPCA9846VerifyLevel
+{
+    kQwVerifyPing = 0,    // The mux ACKs its address
+    kQwVerifyControlRead, // The control register can be read (one byte)
+    kQwVerifyDeviceId     // The Device ID matches (3 bytes from address 0x7C). Default
+};
+
+// Bitmap of the devices found on each port of the mux, and on the upstream bus
+#define SFE_PCA9846_TOPOLOGY_UPSTREAM 4 // Index of the upstream bus
+#define SFE_PCA9846_TOPOLOGY_BUSES 5    // Ports 0-3 plus the upstream bus
+#define SFE_PCA9846_TOPOLOGY_SERIALIZED_MAX (4 + (SFE_PCA9846_TOPOLOGY_BUSES * 16) + 1)
+
+struct QwPCA9846Topology
+{
+    uint32_t present[SFE_PCA9846_TOPOLOGY_BUSES][4]; // One bit per 7-bit address
+    uint8_t scanned;                                 // Bit n: bus n has been scanned
+    uint8_t errors;                                  // Bit n: the last scan of bus n hit a bus error
+    uint8_t dirty;                                   // Bit n: bus n needs rescanning
+
+    void clear();
+
+    bool isPresent(uint8_t bus, uint8_t address) const
+    {
+        return (bus < SFE_PCA9846_TOPOLOGY_BUSES) && (address < 128) && ((present[bus][address >> 5] >> (address & 31)) & 1);
+    }
+
+    // Flag ports (bit n = bus n) for the next rescan
+    void markDirty(uint8_t busMask) { dirty |= busMask; }
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // serialize() / deserialize()
+    //
+    // Compact binary form, for saving the topology across a reset. Only scanned buses
+    // are stored. The buffer needs at most SFE_PCA9846_TOPOLOGY_SERIALIZED_MAX bytes.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  buffer       The binary form
+    //  size         Size of the buffer / of the binary form
+    //  retval       serialize: bytes used, 0 if the buffer is too small
+    //               deserialize: false if the data is corrupt
+
+    uint16_t serialize(uint8_t *buffer, uint16_t size) const;
+    bool deserialize(const uint8_t *buffer, uint16_t size);
+};
+
+// One register write, for broadcastWrite()
+struct QwPCA9846RegisterWrite
+{
+    uint8_t reg;
+    const uint8_t *data;
+    uint16_t length;
+};
+
 class QwDevPCA9846
 {
 public:
-    QwDevPCA9846() : _i2cAddress{SFE_PCA9846_MUX_DEFAULT_ADDRESS} {};
+    QwDevPCA9846() : _sfeBus{nullptr}, _i2cAddress{SFE_PCA9846_MUX_DEFAULT_ADDRESS}, _cacheEnabled{false}, _cacheValid{false}, _portCache{0},
+                     _verifyLevel{kQwVerifyDeviceId}, _idCacheEnabled{false}, _idVerified{false}, _isolatedPorts{0},
+                     _portClock{0, 0, 0, 0}, _defaultClock{SFE_PCA9846_DEFAULT_CLOCK}, _currentClock{0}, _clockProfiles{false} {};
 
     ///////////////////////////////////////////////////////////////////////
     // init()
@@ -36,6 +95,7 @@ public:
     ///////////////////////////////////////////////////////////////////////
     // isConnected()
     //
+    // Performs the check selected by setVerifyLevel() - by default, a Device ID read.
     //
     //  Parameter   Description
     //  ---------   -----------------------------
@@ -43,6 +103,30 @@ public:
 
     bool isConnected(); // Checks if sensor ack's the I2C request
 
+    //////////////////////////////////////////////////////////////////////////////////
+    // setVerifyLevel()
+    //
+    // Select the check isConnected() performs
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  level        kQwVerifyPing, kQwVerifyControlRead or kQwVerifyDeviceId
+
+    void setVerifyLevel(QwPCA9846VerifyLevel level) { _verifyLevel = level; }
+    QwPCA9846VerifyLevel getVerifyLevel() { return _verifyLevel; }
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // enableIdCache()
+    //
+    // Remember a successful Device ID check. While remembered, a kQwVerifyDeviceId
+    // check is reduced to a ping. Any bus error, or invalidateCache(), forgets it.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  enable       true to enable, false to disable
+
+    void enableIdCache(bool enable = true);
+
     //////////////////////////////////////////////////////////////////////////////////
     // write()
     //
@@ -104,6 +188,10 @@ public:
     void setCommunicationBus(sfe_PCA9846::QwIDeviceBus &theBus, uint8_t i2cAddress);
     void setCommunicationBus(sfe_PCA9846::QwIDeviceBus &theBus);
 
+    // The bus object and I2C address in use
+    sfe_PCA9846::QwIDeviceBus *getCommunicationBus() { return _sfeBus; }
+    uint8_t getAddress() { return _i2cAddress; }
+
     uint32_t getUniqueId();
 
     bool setPort(uint8_t portNumber);     // Enable a single port. All other ports disabled.
@@ -113,7 +201,268 @@ public:
     bool enablePort(uint8_t portNumber);  // Enable a single port without affecting other bits
     bool disablePort(uint8_t portNumber); // Disable a single port without affecting other bits
 
+    //////////////////////////////////////////////////////////////////////////////////
+    // enableCache()
+    //
+    // Keep a shadow copy of the control register. While the shadow copy is valid,
+    // getPortState() / getPort() are answered without touching the bus, writes that
+    // would not change the register are skipped, and enablePort() / disablePort()
+    // cost a single write. The cache is off by default.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  enable       true to enable the cache, false to disable (and invalidate) it
+
+    void enableCache(bool enable = true);
+    bool isCacheEnabled() { return _cacheEnabled; }
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // invalidateCache()
+    //
+    // Forget the shadow copy and any remembered Device ID check. The next access
+    // reads the control register from the device. Call this after resetting the
+    // mux or after an external bus error.
+
+    void invalidateCache();
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // resync()
+    //
+    // Re-read the control register from the device and refresh the shadow copy.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  retval       false = error, true = success
+
+    bool resync();
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // getCachedPortState() / setCachedPortState()
+    //
+    // Access the shadow copy directly. Used by code which talks to the mux through
+    // another path (e.g. asynchronously) to keep the shadow copy coherent.
+    // setCachedPortState() does nothing while the cache is disabled.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  portBits     The control register value
+    //  retval       true if the shadow copy is valid
+
+    bool getCachedPortState(uint8_t &portBits);
+    void setCachedPortState(uint8_t portBits);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // isolatePorts()
+    //
+    // Take faulty ports out of service. Requests which would enable an isolated
+    // port (setPort(), setPortState(), enablePort()) fail without touching the bus,
+    // so the remaining ports keep working.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  portMask     Ports to isolate (bit n = port n). 0 returns all ports to service
+
+    void isolatePorts(uint8_t portMask) { _isolatedPorts = portMask & 0x0F; }
+    uint8_t getIsolatedPorts() { return _isolatedPorts; }
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // setPortClock()
+    //
+    // Give a port its own SCL frequency, e.g. 1MHz for Fast-mode Plus devices and
+    // 100kHz for a legacy device. When several ports are enabled, the slowest one
+    // sets the pace. Ports without a profile, and the upstream bus with no port
+    // enabled, use the default clock. The bus clock is only changed when a port
+    // change needs a different frequency. Devices on the upstream bus see every
+    // frequency used, so they must cope with the fastest profile.
+    //
+    // Profiles take effect at the next port change.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  portNumber   The port (0-3)
+    //  clockHz      The SCL frequency. 0 removes the profile
+    //  retval       false = bad port number, true = success
+
+    bool setPortClock(uint8_t portNumber, uint32_t clockHz);
+    uint32_t getPortClock(uint8_t portNumber) { return portNumber < 4 ? _portClock[portNumber] : 0; }
+
+    // Clock for ports without a profile. SFE_PCA9846_DEFAULT_CLOCK unless changed
+    void setDefaultClock(uint32_t clockHz) { _defaultClock = clockHz; }
+    uint32_t getDefaultClock() { return _defaultClock; }
+
+    // The clock last set on the bus by the profiles. 0 = not known
+    uint32_t getClock() { return _currentClock; }
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // prepareClock() / completeClock()
+    //
+    // The clock changes setPortState() makes around a write of the control register,
+    // for code which writes it another way (e.g. QwDevPCA9846Async). Call
+    // prepareClock() before the write: it slows the bus down first if portBits, or
+    // the ports connected now, need it. Call completeClock() once the write has
+    // succeeded: it sets the clock portBits runs at. Both do nothing without
+    // clock profiles.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  portBits     The control register value being written
+
+    void prepareClock(uint8_t portBits);
+    void completeClock(uint8_t portBits);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // probePortClock()
+    //
+    // Find the fastest clock a device on a port handles reliably, and make it the
+    // port's profile. Each candidate, fastest first, is tried with a number of
+    // pings and single byte reads of the device. The port selection is restored
+    // afterwards.
+    //
+    //  Parameter     Description
+    //  ---------     -----------------------------
+    //  portNumber    The port (0-3)
+    //  address       I2C address of a device on the port
+    //  candidates    Clocks to try, fastest first. Default: 1MHz, 400kHz, 100kHz
+    //  numCandidates Number of candidates
+    //  trials        Pings and reads which must all succeed
+    //  retval        The clock chosen, or 0 if none worked (the profile is removed)
+
+    uint32_t probePortClock(uint8_t portNumber, uint8_t address, const uint32_t *candidates = nullptr,
+                            uint8_t numCandidates = 0, uint8_t trials = 4);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // discover()
+    //
+    // Find the devices on each port by pinging them. The port which is already
+    // selected is scanned first, and the selection is restored afterwards. Devices
+    // found on the upstream bus are not reported on the ports as well. The mux's own
+    // addresses are never reported on the ports.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  topology     Results. Buses not scanned are left untouched
+    //  portMask     Ports to scan. Bit 4 (SFE_PCA9846_TOPOLOGY_UPSTREAM) scans the upstream bus
+    //  addressMask  Optional. uint32_t[4] bitmap of the addresses to ping. Default: 0x08-0x77
+    //  retval       false if a bus error occurred, true otherwise
+
+    bool discover(QwPCA9846Topology &topology, uint8_t portMask = 0x1F, const uint32_t *addressMask = nullptr);
+
+    // Scan only the buses which are dirty, had errors, or have never been scanned
+    bool rescan(QwPCA9846Topology &topology, const uint32_t *addressMask = nullptr);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // validateTopology()
+    //
+    // Check a saved topology, e.g. on a warm boot: ping only the devices it lists.
+    // Ports where a device did not answer are marked dirty, ready for rescan().
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  topology     The saved topology
+    //  retval       true if every listed device answered
+
+    bool validateTopology(QwPCA9846Topology &topology);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // broadcastWrite()
+    //
+    // Write the same registers of identical devices (same address) on several ports.
+    // All the ports are enabled together, so each write goes out once. Optionally,
+    // each port is then selected in turn and the registers read back. The previous
+    // port selection is restored afterwards. Only verify registers which read back
+    // what was written.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  portMask     Ports to write to (bit n = port n)
+    //  address      I2C address of the devices
+    //  writes       The register writes, in order
+    //  numWrites    Number of register writes
+    //  verify       Read the registers back from each port
+    //  failedPorts  Optional. Ports whose read back did not match (or failed)
+    //  retval       false = error, true = success
+
+    bool broadcastWrite(uint8_t portMask, uint8_t address, const QwPCA9846RegisterWrite *writes, uint8_t numWrites,
+                        bool verify = false, uint8_t *failedPorts = nullptr);
+
+    // Broadcast a single register write
+    bool broadcastWriteRegion(uint8_t portMask, uint8_t address, uint8_t reg, const uint8_t *data, uint16_t length,
+                              bool verify = false, uint8_t *failedPorts = nullptr);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // transferOnPort()
+    //
+    // Select a port and transfer to a device on it, in one call: write tx, then read
+    // rx with a repeated START (see QwIDeviceBus::transfer()). With the cache enabled
+    // and the port already selected, there is no mux write at all. Otherwise the
+    // selection is handed to the bus along with the transfer.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  portNumber   The port (0-3). It becomes the only port enabled
+    //  address      I2C address of the device
+    //  tx           Bytes to write, e.g. the register offset
+    //  txLength     Number of bytes to write
+    //  rx           Buffer to read into
+    //  rxLength     Number of bytes to read
+    //  retval       false = error, true = success
+
+    bool transferOnPort(uint8_t portNumber, uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx = nullptr,
+                        uint16_t rxLength = 0);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // transferSegmentsOnPort()
+    //
+    // As transferOnPort(), with the bytes written gathered from a list of segments and
+    // the bytes read scattered over another (see QwIDeviceBus::transferSegments()).
+    // For instance, a register offset and a payload from separate buffers:
+    //
+    //    sfe_PCA9846::QwWriteSegment tx[2] = {{&reg, 1}, {payload, sizeof(payload)}};
+    //    myMux.transferSegmentsOnPort(2, 0x48, tx, 2);
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  portNumber   The port (0-3). It becomes the only port enabled
+    //  address      I2C address of the device
+    //  tx           Segments to write
+    //  txCount      Number of segments to write
+    //  rx           Segments to read into
+    //  rxCount      Number of segments to read
+    //  retval       false = error, true = success
+
+    bool transferSegmentsOnPort(uint8_t portNumber, uint8_t address, const sfe_PCA9846::QwWriteSegment *tx, uint8_t txCount,
+                                const sfe_PCA9846::QwReadSegment *rx = nullptr, uint8_t rxCount = 0);
+
 private:
+    // Connect the bus to be scanned: a port, or the upstream bus
+    bool selectBus(uint8_t bus);
+
+    // Clock needed with portBits enabled, and the slowest clock of any profile
+    uint32_t requiredClock(uint8_t portBits);
+    uint32_t slowestClock();
+
+    // Change the bus clock, if it is not already clockHz
+    void setBusClock(uint32_t clockHz);
+
     sfe_PCA9846::QwIDeviceBus *_sfeBus;
     uint8_t _i2cAddress;
+
+    // Shadow copy of the control register
+    bool _cacheEnabled;
+    bool _cacheValid;
+    uint8_t _portCache;
+
+    // Connection checking
+    QwPCA9846VerifyLevel _verifyLevel;
+    bool _idCacheEnabled;
+    bool _idVerified;
+
+    // Ports taken out of service
+    uint8_t _isolatedPorts;
+
+    // Per-port clock profiles. 0 = no profile
+    uint32_t _portClock[4];
+    uint32_t _defaultClock;
+    uint32_t _currentClock; // 0 = not known
+    bool _clockProfiles;    // At least one profile is set
 };
@@ -0,0 +1,261 @@
+// sfe_pca9846_arbiter.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Port leases for sharing a mux between tasks. See sfe_pca9846_arbiter.h
+
+#include "sfe_pca9846_arbiter.h"
+
+#if defined(SFE_PCA9846_HAS_ARBITER)
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor
+//
+
+QwPCA9846Arbiter::QwPCA9846Arbiter(QwDevPCA9846 &mux)
+    : _mux{mux}, _activePort{0xFF}, _holders{0}, _switching{false}, _waiting{0, 0, 0, 0}, _leases{0}, _switches{0}, _waits{0}
+{
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// acquire()
+//
+// A lease on the active port can be granted as long as nobody is waiting for a different port -
+// even with no holders left, or a release / acquire loop on the active port would never let the
+// others in. A lease on another port needs the holders to be gone. The port is switched only
+// with no holders, so a switch never cuts off a transfer in progress.
+//
+// The switch itself is written to the mux without the state lock, so other tasks are not held
+// up behind the bus. While it is in flight the switching task counts as a holder, and
+// _switching stops any other lease being granted until the new port is in place.
+
+QwPCA9846Arbiter::Lease QwPCA9846Arbiter::acquire(uint8_t portNumber)
+{
+    if (portNumber > 3)
+        return Lease();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto othersWaiting = [this, portNumber]()
+    {
+        uint32_t others = 0;
+        for (uint8_t port = 0; port < 4; port++)
+        {
+            if (port != portNumber)
+                others += _waiting[port];
+        }
+        return others;
+    };
+
+    auto canGrant = [this, portNumber, &othersWaiting]()
+    {
+        if (_switching)
+            return false;
+
+        if (_activePort == portNumber)
+            return othersWaiting() == 0;
+
+        return _holders == 0;
+    };
+
+    if (!canGrant())
+    {
+        _waits++;
+        _waiting[portNumber]++;
+        _released.wait(lock, canGrant);
+        _waiting[portNumber]--;
+    }
+
+    _holders++;
+
+    if (_activePort != portNumber)
+    {
+        _switches++;
+        _switching = true;
+        _activePort = 0xFF;
+
+        lock.unlock();
+
+        bool switched;
+        {
+            std::lock_guard<std::mutex> busLock(_busMutex);
+            switched = _mux.setPort(portNumber);
+        }
+
+        lock.lock();
+
+        _switching = false;
+        _released.notify_all(); // Wake the waiters for this port, or for any port if the switch failed
+
+        if (!switched)
+        {
+            _holders--;
+            return Lease();
+        }
+        _activePort = portNumber;
+    }
+
+    _leases++;
+
+    return Lease(this, portNumber);
+}
+
+void QwPCA9846Arbiter::release()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (_holders > 0)
+        _holders--;
+
+    if (_holders == 0)
+        _released.notify_all();
+}
+
+uint32_t QwPCA9846Arbiter::getLeases()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _leases;
+}
+
+uint32_t QwPCA9846Arbiter::getSwitches()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _switches;
+}
+
+uint32_t QwPCA9846Arbiter::getWaits()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _waits;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Lease
+//
+
+QwPCA9846Arbiter::Lease::Lease(Lease &&other) : _arbiter{other._arbiter}, _portNumber{other._portNumber}, _lastError{other._lastError}
+{
+    other._arbiter = nullptr;
+}
+
+QwPCA9846Arbiter::Lease &QwPCA9846Arbiter::Lease::operator=(Lease &&other)
+{
+    if (this != &other)
+    {
+        release();
+        _arbiter = other._arbiter;
+        _portNumber = other._portNumber;
+        _lastError = other._lastError;
+        other._arbiter = nullptr;
+    }
+    return *this;
+}
+
+void QwPCA9846Arbiter::Lease::release()
+{
+    if (!_arbiter)
+        return;
+
+    _arbiter->release();
+    _arbiter = nullptr;
+}
+
+// Each transfer holds the bus lock for its own duration only. The error code is read
+// under the same lock, so it belongs to this transfer
+
+bool QwPCA9846Arbiter::Lease::finish(bool success)
+{
+    _lastError = success ? SFE_PCA9846_BUS_OK : bus()->getLastError();
+    return success;
+}
+
+bool QwPCA9846Arbiter::Lease::noLease()
+{
+    _lastError = SFE_PCA9846_BUS_ERROR_NO_BUS;
+    return false;
+}
+
+bool QwPCA9846Arbiter::Lease::ping(uint8_t address)
+{
+    if (!_arbiter)
+        return noLease();
+
+    std::lock_guard<std::mutex> busLock(_arbiter->_busMutex);
+    return finish(bus()->ping(address));
+}
+
+bool QwPCA9846Arbiter::Lease::write(uint8_t address, uint8_t data)
+{
+    if (!_arbiter)
+        return noLease();
+
+    std::lock_guard<std::mutex> busLock(_arbiter->_busMutex);
+    return finish(bus()->write(address, data));
+}
+
+bool QwPCA9846Arbiter::Lease::writeRegisterByte(uint8_t address, uint8_t offset, uint8_t data)
+{
+    if (!_arbiter)
+        return noLease();
+
+    std::lock_guard<std::mutex> busLock(_arbiter->_busMutex);
+    return finish(bus()->writeRegisterByte(address, offset, data));
+}
+
+bool QwPCA9846Arbiter::Lease::writeRegisterRegion(uint8_t address, uint8_t offset, const uint8_t *data, uint16_t length)
+{
+    if (!_arbiter)
+        return noLease();
+
+    std::lock_guard<std::mutex> busLock(_arbiter->_busMutex);
+    return finish(bus()->writeRegisterRegion(address, offset, data, length));
+}
+
+bool QwPCA9846Arbiter::Lease::read(uint8_t address, uint8_t *data)
+{
+    if (!_arbiter)
+        return noLease();
+
+    std::lock_guard<std::mutex> busLock(_arbiter->_busMutex);
+    return finish(bus()->read(address, data));
+}
+
+bool QwPCA9846Arbiter::Lease::readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length)
+{
+    if (!_arbiter)
+        return noLease();
+
+    std::lock_guard<std::mutex> busLock(_arbiter->_busMutex);
+    return finish(bus()->readRegisterRegion(address, offset, data, length));
+}
+
+uint16_t QwPCA9846Arbiter::Lease::maxTransferLength()
+{
+    if (!_arbiter || !bus())
+        return SFE_PCA9846_I2C_BUFFER_LENGTH;
+
+    return bus()->maxTransferLength();
+}
+
+#endif
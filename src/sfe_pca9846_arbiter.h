@@ -0,0 +1,146 @@
+// sfe_pca9846_arbiter.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwPCA9846Arbiter class shares one mux between several threads or RTOS
+// tasks. A task calls acquire() to get a lease on a port. While any lease is
+// held, the mux stays on that port: other leases on the same port are granted
+// straight away and share it, and leases on other ports wait until the last
+// holder releases. To stop one port from starving the others, new requests for
+// the active port also wait while a request for another port is pending.
+//
+// A lease is itself a QwIDeviceBus, so a downstream driver can be handed the
+// lease as its bus. Each transfer holds a bus lock only for its own duration,
+// so holders sharing a port interleave whole transactions.
+//
+// Once an arbiter is in use, the mux must only be accessed through it.
+// Needs std::mutex and std::condition_variable (desktop, ESP32, ...).
+
+#pragma once
+
+#include "sfe_pca9846.h"
+
+#if defined(__has_include)
+#if __has_include(<mutex>) && __has_include(<condition_variable>)
+#include <condition_variable>
+#include <mutex>
+#if !defined(__GLIBCXX__) || defined(_GLIBCXX_HAS_GTHREADS)
+#define SFE_PCA9846_HAS_ARBITER 1
+#endif
+#endif
+#endif
+
+#if defined(SFE_PCA9846_HAS_ARBITER)
+
+class QwPCA9846Arbiter
+{
+public:
+    class Lease : public sfe_PCA9846::QwIDeviceBus
+    {
+    public:
+        Lease() : _arbiter{nullptr}, _portNumber{0xFF}, _lastError{SFE_PCA9846_BUS_ERROR_NO_BUS} {}
+        Lease(Lease &&other);
+        Lease &operator=(Lease &&other);
+        ~Lease() { release(); }
+
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        bool isValid() { return _arbiter != nullptr; }
+        uint8_t getPortNumber() { return _portNumber; }
+
+        // Give the port back. Called by the destructor
+        void release();
+
+        bool ping(uint8_t address);
+
+        bool write(uint8_t address, uint8_t data);
+
+        bool writeRegisterByte(uint8_t address, uint8_t offset, uint8_t data);
+
+        bool writeRegisterRegion(uint8_t address, uint8_t offset, const uint8_t *data, uint16_t length);
+
+        bool read(uint8_t address, uint8_t *data);
+
+        bool readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length);
+
+        uint8_t getLastError() { return _lastError; }
+
+        uint16_t maxTransferLength();
+
+    private:
+        friend class QwPCA9846Arbiter;
+
+        Lease(QwPCA9846Arbiter *arbiter, uint8_t portNumber) : _arbiter{arbiter}, _portNumber{portNumber}, _lastError{SFE_PCA9846_BUS_OK} {}
+
+        sfe_PCA9846::QwIDeviceBus *bus() { return _arbiter->_mux.getCommunicationBus(); }
+
+        // Record the outcome of a transfer
+        bool finish(bool success);
+        bool noLease();
+
+        QwPCA9846Arbiter *_arbiter;
+        uint8_t _portNumber;
+        uint8_t _lastError;
+    };
+
+    QwPCA9846Arbiter(QwDevPCA9846 &mux);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // acquire()
+    //
+    // Wait for a lease on a port. The port is selected, if it is not already.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  portNumber   Port to lease (0-3)
+    //  retval       The lease. Not valid if the port number is bad or selecting it failed
+
+    Lease acquire(uint8_t portNumber);
+
+    // Leases granted, port switches made, and leases which had to wait
+    uint32_t getLeases();
+    uint32_t getSwitches();
+    uint32_t getWaits();
+
+private:
+    void release();
+
+    QwDevPCA9846 &_mux;
+
+    std::mutex _mutex; // Guards the lease state below
+    std::condition_variable _released;
+    uint8_t _activePort; // 0xFF = none
+    uint8_t _holders;
+    bool _switching; // A port switch is being written to the mux
+    uint16_t _waiting[4];
+
+    std::mutex _busMutex; // Held for the duration of each transfer
+
+    uint32_t _leases;
+    uint32_t _switches;
+    uint32_t _waits;
+};
+
+#endif
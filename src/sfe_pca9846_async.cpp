@@ -0,0 +1,192 @@
+/*
+  This is an Arduino library written for the PCA9846 4-port multiplexer.
+  By Paul Clark @ SparkFun Electronics, June 18th, 2023
+
+  The PCA9846 allows up to 4 devices to be attached to a single
+  I2C bus. This is helpful for I2C devices that have a single I2C address.
+
+  https://github.com/sparkfun/SparkFun_PCA9846_Mux_Arduino_Library
+
+  SparkFun labored with love to create this code. Feel like supporting open
+  source? Buy a board from SparkFun!
+  https://www.sparkfun.com/products/22362
+*/
+
+#include "sfe_pca9846_async.h"
+
+using namespace sfe_PCA9846;
+
+//////////////////////////////////////////////////////////////////////////////
+// Constructor
+//
+
+QwDevPCA9846Async::QwDevPCA9846Async(QwDevPCA9846 &mux, QwIAsyncDeviceBus &bus)
+    : _mux{mux}, _bus{bus}, _callback{nullptr}, _context{nullptr}, _step{kStepNone}, _status{kQwAsyncIdle}, _result{0}
+{
+}
+
+void QwDevPCA9846Async::setCallback(Callback callback, void *context)
+{
+    _callback = callback;
+    _context = context;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// start()
+//
+// Start the first bus transfer of an operation
+
+bool QwDevPCA9846Async::start(Step step, const QwAsyncTransfer &transfer)
+{
+    if (_status == kQwAsyncBusy)
+        return false;
+
+    if (!_bus.startTransfer(transfer))
+        return false;
+
+    _step = step;
+    _status = kQwAsyncBusy;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// finish()
+//
+// Complete the operation. A failure leaves the control register unknown
+
+void QwDevPCA9846Async::finish(bool success)
+{
+    if (!success)
+        _mux.invalidateCache();
+
+    _step = kStepNone;
+    _status = success ? kQwAsyncDone : kQwAsyncError;
+
+    if (_callback)
+        _callback(_status, _context);
+}
+
+// Enables one port. Disables all others.
+// If port number if out of range, disable all ports
+bool QwDevPCA9846Async::beginSetPort(uint8_t portNumber)
+{
+    return beginSetPortState(portNumber > 3 ? 0 : 1 << portNumber);
+}
+
+// As QwDevPCA9846::setPortState(), the write is skipped if the shadow copy already holds portBits:
+// the operation completes at once. Otherwise the clock profiles are applied around the write,
+// slowest first
+
+bool QwDevPCA9846Async::beginSetPortState(uint8_t portBits)
+{
+    if ((_status == kQwAsyncBusy) || (portBits & _mux.getIsolatedPorts()))
+        return false;
+
+    uint8_t cached;
+    if (_mux.getCachedPortState(cached) && (cached == portBits))
+    {
+        finish(true);
+        return true;
+    }
+
+    _mux.prepareClock(portBits);
+
+    _tx[0] = portBits;
+    QwAsyncTransfer transfer = {_mux.getAddress(), _tx, 1, nullptr, 0};
+    return start(kStepSetState, transfer);
+}
+
+bool QwDevPCA9846Async::beginGetPortState()
+{
+    QwAsyncTransfer transfer = {_mux.getAddress(), nullptr, 0, _rx, 1};
+    return start(kStepGetState, transfer);
+}
+
+// The Device ID is read from address 0x7C using the mux address (shifted left by one) as the offset
+bool QwDevPCA9846Async::beginGetUniqueId()
+{
+    _tx[0] = _mux.getAddress() << 1;
+    QwAsyncTransfer transfer = {SFE_PCA9846_MUX_DEVICE_ID_ADDRESS, _tx, 1, _rx, 3};
+    return start(kStepGetId, transfer);
+}
+
+uint32_t QwDevPCA9846Async::getUniqueIdResult()
+{
+    return (((uint32_t)_rx[0]) << 16) | (((uint32_t)_rx[1]) << 8) | _rx[2];
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// beginTransferOnPort()
+//
+// If the shadow copy says the port is already the only one selected, go straight to the transfer.
+// Otherwise select it first, with the clock profiles applied around the selection as
+// QwDevPCA9846::setPortState() does
+
+bool QwDevPCA9846Async::beginTransferOnPort(uint8_t portNumber, const QwAsyncTransfer &transfer)
+{
+    if ((_status == kQwAsyncBusy) || (portNumber > 3) || ((1 << portNumber) & _mux.getIsolatedPorts()))
+        return false;
+
+    uint8_t portBits;
+    if (_mux.getCachedPortState(portBits) && (portBits == (1 << portNumber)))
+        return start(kStepTransfer, transfer);
+
+    _downstream = transfer;
+    _tx[0] = 1 << portNumber;
+    _mux.prepareClock(_tx[0]);
+    QwAsyncTransfer select = {_mux.getAddress(), _tx, 1, nullptr, 0};
+    return start(kStepSelect, select);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// poll()
+//
+
+QwAsyncStatus QwDevPCA9846Async::poll()
+{
+    if (_status != kQwAsyncBusy)
+        return _status;
+
+    QwAsyncStatus busStatus = _bus.poll();
+
+    if (busStatus == kQwAsyncBusy)
+        return _status;
+
+    if (busStatus != kQwAsyncDone)
+    {
+        finish(false);
+        return _status;
+    }
+
+    switch (_step)
+    {
+    case kStepSetState:
+        _mux.completeClock(_tx[0]);
+        _mux.setCachedPortState(_tx[0]);
+        finish(true);
+        break;
+
+    case kStepGetState:
+        _result = _rx[0];
+        _mux.setCachedPortState(_result);
+        finish(true);
+        break;
+
+    case kStepSelect:
+        _mux.completeClock(_tx[0]);
+        _mux.setCachedPortState(_tx[0]);
+        if (!_bus.startTransfer(_downstream))
+        {
+            finish(false);
+            break;
+        }
+        _step = kStepTransfer;
+        break;
+
+    default:
+        finish(true);
+        break;
+    }
+
+    return _status;
+}
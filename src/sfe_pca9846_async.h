@@ -0,0 +1,110 @@
+/*
+  This is an Arduino library written for the PCA9846 4-port multiplexer.
+  By Paul Clark @ SparkFun Electronics, June 18th, 2023
+
+  The PCA9846 allows up to 4 devices to be attached to a single
+  I2C bus. This is helpful for I2C devices that have a single I2C address.
+
+  https://github.com/sparkfun/SparkFun_PCA9846_Mux_Arduino_Library
+
+  SparkFun labored with love to create this code. Feel like supporting open
+  source? Buy a board from SparkFun!
+  https://www.sparkfun.com/products/22362
+*/
+
+// QwDevPCA9846Async is the non-blocking counterpart of QwDevPCA9846. Each
+// begin...() call starts an operation and returns straight away; poll() drives
+// it and returns kQwAsyncBusy until it completes. One operation runs at a time.
+//
+// It shares the shadow copy of the control register with the QwDevPCA9846 it
+// is given, so blocking and non-blocking calls can be mixed, and
+// beginTransferOnPort() skips the port selection when the port is already
+// selected. Likewise, beginSetPortState() completes at once, without a bus
+// transfer, when the shadow copy already holds the value. As with the
+// blocking calls, ports taken out of service (isolatePorts()) are refused.
+//
+// Port clock profiles (QwDevPCA9846::setPortClock()) apply too. The clock is
+// changed on the mux's own bus, between transfers, so the asynchronous bus
+// must run on the same I2C controller.
+
+#pragma once
+
+#include "sfe_async_bus.h"
+#include "sfe_pca9846.h"
+
+class QwDevPCA9846Async
+{
+public:
+    typedef void (*Callback)(sfe_PCA9846::QwAsyncStatus status, void *context);
+
+    QwDevPCA9846Async(QwDevPCA9846 &mux, sfe_PCA9846::QwIAsyncDeviceBus &bus);
+
+    // Called once when an operation completes, from within poll()
+    void setCallback(Callback callback, void *context = nullptr);
+
+    bool beginSetPort(uint8_t portNumber);     // Enable a single port. All other ports disabled
+    bool beginSetPortState(uint8_t portBits);  // Overwrite the port register. Done at once on a cache hit
+    bool beginGetPortState();                  // Read the port register. See getResult()
+    bool beginGetUniqueId();                   // Read the Device ID. See getUniqueIdResult()
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // beginTransferOnPort()
+    //
+    // Select a port (if it is not selected already), then run a transfer on it.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  portNumber   Port the device is attached to (0-3)
+    //  transfer     The transfer. Its buffers must stay valid until completion
+    //  retval       false = busy, bad parameter or isolated port, true = started
+
+    bool beginTransferOnPort(uint8_t portNumber, const sfe_PCA9846::QwAsyncTransfer &transfer);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // poll()
+    //
+    // Drive the operation in progress.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  retval       kQwAsyncBusy while in progress, then kQwAsyncDone or kQwAsyncError
+
+    sfe_PCA9846::QwAsyncStatus poll();
+
+    sfe_PCA9846::QwAsyncStatus getStatus() { return _status; }
+    bool isBusy() { return _status == sfe_PCA9846::kQwAsyncBusy; }
+
+    // Port register read by beginGetPortState()
+    uint8_t getResult() { return _result; }
+
+    // Device ID read by beginGetUniqueId()
+    uint32_t getUniqueIdResult();
+
+private:
+    enum Step
+    {
+        kStepNone = 0,
+        kStepSetState, // Writing the control register
+        kStepGetState, // Reading the control register
+        kStepGetId,    // Reading the Device ID
+        kStepSelect,   // Writing the control register, then the downstream transfer
+        kStepTransfer  // Downstream transfer
+    };
+
+    bool start(Step step, const sfe_PCA9846::QwAsyncTransfer &transfer);
+    void finish(bool success);
+
+    QwDevPCA9846 &_mux;
+    sfe_PCA9846::QwIAsyncDeviceBus &_bus;
+
+    Callback _callback;
+    void *_context;
+
+    Step _step;
+    sfe_PCA9846::QwAsyncStatus _status;
+
+    uint8_t _tx[1];
+    uint8_t _rx[3];
+    uint8_t _result;
+    sfe_PCA9846::QwAsyncTransfer _downstream; // Pending downstream transfer while selecting
+};
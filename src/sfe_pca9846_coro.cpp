@@ -0,0 +1,253 @@
+// sfe_pca9846_coro.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Coroutine front-end for the non-blocking mux API. See sfe_pca9846_coro.h
+
+#include "sfe_pca9846_coro.h"
+
+#if defined(SFE_PCA9846_HAS_COROUTINES)
+
+using namespace sfe_PCA9846;
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// QwPCA9846Executor
+//
+
+QwPCA9846Executor::QwPCA9846Executor() : _numTasks{0}, _head{nullptr}, _tail{nullptr}, _ticks{0}, _resumes{0}
+{
+}
+
+// Tasks still running are destroyed, along with their frames
+QwPCA9846Executor::~QwPCA9846Executor()
+{
+    for (uint8_t i = 0; i < _numTasks; i++)
+        _tasks[i].destroy();
+}
+
+bool QwPCA9846Executor::spawn(QwPCA9846Task &&task)
+{
+    if (_numTasks >= SFE_PCA9846_CORO_MAX_TASKS)
+        return false;
+
+    std::coroutine_handle<QwPCA9846Task::promise_type> handle = task.release();
+    if (!handle)
+        return false;
+
+    _tasks[_numTasks] = handle;
+    _started[_numTasks] = false;
+    _numTasks++;
+    return true;
+}
+
+void QwPCA9846Executor::wait(Waiter &waiter, std::coroutine_handle<> handle)
+{
+    waiter._handle = handle;
+    waiter._next = nullptr;
+
+    if (_tail)
+        _tail->_next = &waiter;
+    else
+        _head = &waiter;
+    _tail = &waiter;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// runOnce()
+//
+// A resumed task may queue a new waiter before it suspends again. It goes on the end of the list,
+// behind the 'last' marker, so it is first stepped on the next tick.
+
+bool QwPCA9846Executor::runOnce()
+{
+    for (uint8_t i = 0; i < _numTasks; i++)
+    {
+        if (!_started[i])
+        {
+            _started[i] = true;
+            _tasks[i].resume();
+        }
+    }
+
+    Waiter *previous = nullptr;
+    Waiter *waiter = _head;
+    Waiter *last = _tail;
+
+    while (waiter)
+    {
+        Waiter *next = waiter->_next;
+        bool final = waiter == last;
+
+        if (waiter->step())
+        {
+            // Unlink before resuming: the waiter lives in the task's frame
+            if (previous)
+                previous->_next = next;
+            else
+                _head = next;
+            if (_tail == waiter)
+                _tail = previous;
+
+            _resumes++;
+            waiter->_handle.resume();
+        }
+        else
+        {
+            previous = waiter;
+        }
+
+        if (final)
+            break;
+        waiter = next;
+    }
+
+    // Remove the tasks which have finished, keeping the order of the rest
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < _numTasks; i++)
+    {
+        if (_tasks[i].done())
+        {
+            _tasks[i].destroy();
+            continue;
+        }
+
+        _tasks[kept] = _tasks[i];
+        _started[kept] = _started[i];
+        kept++;
+    }
+    _numTasks = kept;
+
+    _ticks++;
+    return _numTasks > 0;
+}
+
+uint32_t QwPCA9846Executor::run(uint32_t maxTicks)
+{
+    uint32_t ticks = 0;
+
+    while ((ticks < maxTicks) && runOnce())
+        ticks++;
+
+    return ticks;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// QwDevPCA9846Coro
+//
+
+QwDevPCA9846Coro::QwDevPCA9846Coro(QwDevPCA9846 &mux, QwIAsyncDeviceBus &bus, QwPCA9846Executor &executor)
+    : _async{mux, bus}, _executor{executor}
+{
+}
+
+QwDevPCA9846Coro::Operation QwDevPCA9846Coro::setPort(uint8_t portNumber)
+{
+    return Operation(*this, Operation::kSetPortState, portNumber > 3 ? 0 : 1 << portNumber);
+}
+
+QwDevPCA9846Coro::Operation QwDevPCA9846Coro::setPortState(uint8_t portBits)
+{
+    return Operation(*this, Operation::kSetPortState, portBits);
+}
+
+QwDevPCA9846Coro::Operation QwDevPCA9846Coro::getPortState(uint8_t &portBits)
+{
+    return Operation(*this, Operation::kGetPortState, 0, 0, &portBits);
+}
+
+QwDevPCA9846Coro::Operation QwDevPCA9846Coro::readRegisterRegion(uint8_t portNumber, uint8_t address, uint8_t offset, uint8_t *data,
+                                                                 uint16_t length)
+{
+    QwAsyncTransfer transfer = {address, nullptr, 1, data, length};
+    return Operation(*this, Operation::kReadRegisterRegion, portNumber, offset, nullptr, transfer);
+}
+
+QwDevPCA9846Coro::Operation QwDevPCA9846Coro::transferOnPort(uint8_t portNumber, uint8_t address, const uint8_t *tx,
+                                                             uint16_t txLength, uint8_t *rx, uint16_t rxLength)
+{
+    QwAsyncTransfer transfer = {address, tx, txLength, rx, rxLength};
+    return Operation(*this, Operation::kTransferOnPort, portNumber, 0, nullptr, transfer);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Operation::begin()
+//
+// The register offset lives in the operation, which does not move once the task is suspended
+
+bool QwDevPCA9846Coro::Operation::begin()
+{
+    QwDevPCA9846Async &async = _coro._async;
+
+    switch (_kind)
+    {
+    case kSetPortState:
+        return async.beginSetPortState(_port);
+
+    case kGetPortState:
+        return async.beginGetPortState();
+
+    case kReadRegisterRegion:
+        _transfer.tx = &_offset;
+        return async.beginTransferOnPort(_port, _transfer);
+
+    default:
+        return async.beginTransferOnPort(_port, _transfer);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Operation::step()
+//
+// Wait for the mux to be free, start, then poll until done. The result is picked up straight
+// away, before the next operation on the mux can overwrite it.
+
+bool QwDevPCA9846Coro::Operation::step()
+{
+    QwDevPCA9846Async &async = _coro._async;
+
+    if (!_started)
+    {
+        if (async.isBusy())
+            return false;
+
+        if (!begin())
+        {
+            _success = false; // Bad parameter, or the bus would not start
+            return true;
+        }
+        _started = true;
+    }
+
+    QwAsyncStatus status = async.poll();
+    if (status == kQwAsyncBusy)
+        return false;
+
+    _success = status == kQwAsyncDone;
+    if (_success && _result)
+        *_result = async.getResult();
+
+    return true;
+}
+
+#endif
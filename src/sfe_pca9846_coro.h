@@ -0,0 +1,310 @@
+// sfe_pca9846_coro.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// C++20 coroutine front-end for the non-blocking mux API (QwDevPCA9846Async).
+// A QwPCA9846Task is a coroutine which co_awaits mux operations:
+//
+//    QwPCA9846Task readSensor(QwDevPCA9846Coro &mux, uint8_t *data)
+//    {
+//        if (co_await mux.readRegisterRegion(2, 0x48, 0x00, data, 2))
+//            ...
+//    }
+//
+// Tasks are run by a QwPCA9846Executor: a single-threaded, round-robin loop.
+// Each runOnce() polls every operation in flight once and resumes the tasks
+// whose operation has completed, so tasks on different muxes (each with its
+// own QwIAsyncDeviceBus) interleave, and operations on the same mux run one
+// after the other, in the order they were awaited. Nothing is allocated apart
+// from the coroutine frames.
+//
+// With QwPolledAsyncBus over QwSimBus the executor is deterministic: every
+// operation takes a fixed number of runOnce() calls (ticks), on any machine.
+//
+// Needs a C++20 compiler; otherwise this header is empty.
+
+#pragma once
+
+#include "sfe_pca9846_async.h"
+
+#if defined(__has_include)
+#if __has_include(<coroutine>) && (__cplusplus >= 202002L) && defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+#define SFE_PCA9846_HAS_COROUTINES 1
+#endif
+#endif
+
+#if defined(SFE_PCA9846_HAS_COROUTINES)
+
+// Maximum number of tasks an executor runs at once
+#ifndef SFE_PCA9846_CORO_MAX_TASKS
+#define SFE_PCA9846_CORO_MAX_TASKS 8
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////
+// QwPCA9846Task
+//
+// The return type of a coroutine run by the executor. A task starts suspended: hand
+// it to QwPCA9846Executor::spawn(), or co_await it from another task, which then
+// continues when it has finished.
+
+class QwPCA9846Task
+{
+public:
+    struct promise_type
+    {
+        std::coroutine_handle<> continuation;
+
+        QwPCA9846Task get_return_object() { return QwPCA9846Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        // Resume the awaiting task, if there is one. A spawned task stays suspended until the executor destroys it
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+            {
+                std::coroutine_handle<> continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    QwPCA9846Task(QwPCA9846Task &&other) : _handle{other._handle} { other._handle = nullptr; }
+    ~QwPCA9846Task()
+    {
+        if (_handle)
+            _handle.destroy();
+    }
+
+    QwPCA9846Task(const QwPCA9846Task &) = delete;
+    QwPCA9846Task &operator=(const QwPCA9846Task &) = delete;
+
+    // co_await a task: run it to completion, then continue
+    bool await_ready() { return !_handle || _handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller)
+    {
+        _handle.promise().continuation = caller;
+        return _handle;
+    }
+    void await_resume() {}
+
+    // Hand the coroutine over, e.g. to the executor
+    std::coroutine_handle<promise_type> release()
+    {
+        std::coroutine_handle<promise_type> handle = _handle;
+        _handle = nullptr;
+        return handle;
+    }
+
+private:
+    explicit QwPCA9846Task(std::coroutine_handle<promise_type> handle) : _handle{handle} {}
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+class QwPCA9846Executor
+{
+public:
+    //////////////////////////////////////////////////////////////////////////////////
+    // Waiter
+    //
+    // Base of everything a task can wait on. step() is called once per tick until it
+    // returns true; then the task is resumed.
+
+    class Waiter
+    {
+    public:
+        virtual bool step() = 0;
+
+    protected:
+        ~Waiter() = default;
+
+    private:
+        friend class QwPCA9846Executor;
+
+        Waiter *_next = nullptr;
+        std::coroutine_handle<> _handle;
+    };
+
+    // Resumes the task on the next tick, after the other tasks have had their turn
+    class Yield : public Waiter
+    {
+    public:
+        explicit Yield(QwPCA9846Executor &executor) : _executor{executor} {}
+
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { _executor.wait(*this, handle); }
+        void await_resume() {}
+
+        bool step() { return true; }
+
+    private:
+        QwPCA9846Executor &_executor;
+    };
+
+    QwPCA9846Executor();
+    ~QwPCA9846Executor();
+
+    QwPCA9846Executor(const QwPCA9846Executor &) = delete;
+    QwPCA9846Executor &operator=(const QwPCA9846Executor &) = delete;
+
+    // Take over a task. It starts on the next tick. Returns false if there is no room
+    bool spawn(QwPCA9846Task &&task);
+
+    // co_await executor.yield() to let the other tasks run
+    Yield yield() { return Yield(*this); }
+
+    // Queue a waiter for the task with the given handle. Called from await_suspend()
+    void wait(Waiter &waiter, std::coroutine_handle<> handle);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // runOnce()
+    //
+    // One tick: start the tasks spawned since the last tick, step every waiter once -
+    // in the order they were queued - resuming the tasks whose waiter is done, then
+    // destroy the tasks which have finished.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  retval       true while any task has not finished
+
+    bool runOnce();
+
+    // Run ticks until every task has finished, or maxTicks have run. Returns the ticks run
+    uint32_t run(uint32_t maxTicks = 0xFFFFFFFF);
+
+    uint8_t getTasks() { return _numTasks; }
+    uint32_t getTicks() { return _ticks; }
+
+    // Number of times a task was resumed after waiting
+    uint32_t getResumes() { return _resumes; }
+
+private:
+    std::coroutine_handle<QwPCA9846Task::promise_type> _tasks[SFE_PCA9846_CORO_MAX_TASKS];
+    bool _started[SFE_PCA9846_CORO_MAX_TASKS];
+    uint8_t _numTasks;
+
+    Waiter *_head;
+    Waiter *_tail;
+
+    uint32_t _ticks;
+    uint32_t _resumes;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+// QwDevPCA9846Coro
+//
+// Awaitable mux operations. Each one co_awaits to true on success, false on error.
+// Buffers passed in must stay valid until the operation completes - which, since the
+// task is suspended meanwhile, they do if they live in the task.
+
+class QwDevPCA9846Coro
+{
+public:
+    class Operation : public QwPCA9846Executor::Waiter
+    {
+    public:
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { _coro._executor.wait(*this, handle); }
+        bool await_resume() { return _success; }
+
+        bool step();
+
+    private:
+        friend class QwDevPCA9846Coro;
+
+        enum Kind
+        {
+            kSetPortState,
+            kGetPortState,
+            kReadRegisterRegion,
+            kTransferOnPort
+        };
+
+        Operation(QwDevPCA9846Coro &coro, Kind kind, uint8_t port, uint8_t offset = 0, uint8_t *result = nullptr,
+                  const sfe_PCA9846::QwAsyncTransfer &transfer = {})
+            : _coro{coro}, _kind{kind}, _port{port}, _offset{offset}, _result{result}, _transfer(transfer)
+        {
+        }
+
+        Operation(const Operation &) = delete;
+        Operation &operator=(const Operation &) = delete;
+
+        // Start the operation on the mux, if it is free
+        bool begin();
+
+        QwDevPCA9846Coro &_coro;
+        Kind _kind;
+        uint8_t _port; // Port bits for kSetPortState, otherwise the port number
+        uint8_t _offset;
+        uint8_t *_result;
+        sfe_PCA9846::QwAsyncTransfer _transfer;
+
+        bool _started = false;
+        bool _success = false;
+    };
+
+    QwDevPCA9846Coro(QwDevPCA9846 &mux, sfe_PCA9846::QwIAsyncDeviceBus &bus, QwPCA9846Executor &executor);
+
+    Operation setPort(uint8_t portNumber);     // Enable a single port. All other ports disabled
+    Operation setPortState(uint8_t portBits);  // Overwrite the port register
+    Operation getPortState(uint8_t &portBits); // Read the port register
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // readRegisterRegion()
+    //
+    // Select a port, if it is not selected already, and read registers from a device on it.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  portNumber   Port the device is attached to (0-3)
+    //  address      I2C address of the device
+    //  offset       First register
+    //  data         Buffer to read into
+    //  length       Number of bytes to read
+
+    Operation readRegisterRegion(uint8_t portNumber, uint8_t address, uint8_t offset, uint8_t *data, uint16_t length);
+
+    // Select a port, if it is not selected already, then write tx and read rx (see QwAsyncTransfer)
+    Operation transferOnPort(uint8_t portNumber, uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx = nullptr,
+                             uint16_t rxLength = 0);
+
+    QwDevPCA9846Async &getAsync() { return _async; }
+
+private:
+    QwDevPCA9846Async _async;
+    QwPCA9846Executor &_executor;
+};
+
+#endif
@@ -0,0 +1,335 @@
+// sfe_pca9846_hotplug.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Budgeted hot-plug detection. See sfe_pca9846_hotplug.h
+
+#include "sfe_pca9846_hotplug.h"
+
+// Bit times on the wire: START, address + ACK, (data + ACK), STOP
+static const uint32_t kPingBits = 1 + 9 + 1;
+static const uint32_t kSelectBits = 1 + 9 + 9 + 1;
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor
+//
+
+QwPCA9846HotPlug::QwPCA9846HotPlug(QwDevPCA9846 &mux)
+    : _mux{mux}, _numWatches{0}, _cursor{0}, _callback{nullptr}, _context{nullptr}, _budgetMicros{1000}, _clockHz{0}, _debounce{2},
+      _credit{0}, _probes{0}, _bitsUsed{0}
+{
+}
+
+void QwPCA9846HotPlug::setCallback(QwPCA9846HotPlugCallback callback, void *context)
+{
+    _callback = callback;
+    _context = context;
+}
+
+void QwPCA9846HotPlug::setBudget(uint32_t budgetMicros, uint32_t clockHz)
+{
+    _budgetMicros = budgetMicros;
+    _clockHz = clockHz;
+}
+
+uint32_t QwPCA9846HotPlug::clock()
+{
+    if (_clockHz)
+        return _clockHz;
+
+    return _mux.getClock() ? _mux.getClock() : SFE_PCA9846_DEFAULT_CLOCK;
+}
+
+uint32_t QwPCA9846HotPlug::getBusMicros()
+{
+    return (uint32_t)(((uint64_t)_bitsUsed * 1000000 + clock() - 1) / clock());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// watch()
+//
+// Insert in port order
+
+bool QwPCA9846HotPlug::watch(uint8_t portNumber, uint8_t address, bool present)
+{
+    if ((_numWatches >= SFE_PCA9846_HOTPLUG_MAX_WATCHES) || ((portNumber > 3) && (portNumber != SFE_PCA9846_TOPOLOGY_UPSTREAM)))
+        return false;
+
+    uint8_t i = _numWatches;
+    while ((i > 0) && (_watches[i - 1].portNumber > portNumber))
+    {
+        _watches[i] = _watches[i - 1];
+        i--;
+    }
+
+    _watches[i].portNumber = portNumber;
+    _watches[i].address = address;
+    _watches[i].present = present;
+    _watches[i].streak = 0;
+    _numWatches++;
+
+    if ((i < _cursor) && (_cursor < _numWatches - 1))
+        _cursor++;
+
+    return true;
+}
+
+bool QwPCA9846HotPlug::watch(const QwPCA9846Topology &topology)
+{
+    for (uint8_t bus = 0; bus < SFE_PCA9846_TOPOLOGY_BUSES; bus++)
+    {
+        for (uint8_t address = 0; address < 128; address++)
+        {
+            if (topology.isPresent(bus, address) && !watch(bus, address, true))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool QwPCA9846HotPlug::unwatch(uint8_t portNumber, uint8_t address)
+{
+    for (uint8_t i = 0; i < _numWatches; i++)
+    {
+        if ((_watches[i].portNumber != portNumber) || (_watches[i].address != address))
+            continue;
+
+        for (uint8_t j = i; j + 1 < _numWatches; j++)
+            _watches[j] = _watches[j + 1];
+        _numWatches--;
+
+        if (i < _cursor)
+            _cursor--;
+        if (_cursor >= _numWatches)
+            _cursor = 0;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool QwPCA9846HotPlug::isPresent(uint8_t portNumber, uint8_t address)
+{
+    for (uint8_t i = 0; i < _numWatches; i++)
+    {
+        if ((_watches[i].portNumber == portNumber) && (_watches[i].address == address))
+            return _watches[i].present;
+    }
+
+    return false;
+}
+
+uint32_t QwPCA9846HotPlug::budgetBits()
+{
+    return (uint32_t)(((uint64_t)_budgetMicros * clock()) / 1000000);
+}
+
+uint32_t QwPCA9846HotPlug::maxCredit()
+{
+    uint32_t budget = budgetBits();
+    uint32_t probe = kPingBits + (3 * kSelectBits); // Read, select and restore, with the cache off
+
+    return budget > probe ? budget : probe;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// sweepTicks()
+//
+// Run tick()'s spending rules, without the bus, to count the ticks a full sweep takes starting at
+// watch 'start'. Worst case: every probe needs a select, and every tick ends with a restore - and,
+// with the cache off, starts with a read of the selection.
+
+uint32_t QwPCA9846HotPlug::sweepTicks(uint8_t start)
+{
+    uint32_t budget = budgetBits();
+    uint32_t limit = maxCredit();
+    uint32_t credit = 0;
+    uint32_t ticks = 0;
+    uint8_t index = start;
+    uint8_t remaining = _numWatches;
+    uint32_t read = _mux.isCacheEnabled() ? 0 : kSelectBits;
+
+    while (remaining > 0)
+    {
+        ticks++;
+        credit = (credit + budget > limit) ? limit : credit + budget;
+
+        uint8_t selected = 0xFF;
+
+        while (remaining > 0)
+        {
+            uint8_t wanted = portBits(_watches[index].portNumber);
+            bool skip = (wanted & _mux.getIsolatedPorts()) != 0;
+
+            if (!skip)
+            {
+                uint32_t select = (wanted != selected) ? kSelectBits : 0;
+                if (selected == 0xFF)
+                    select += read;
+                if (credit < kPingBits + select + kSelectBits)
+                    break;
+
+                credit -= kPingBits + select;
+                selected = wanted;
+            }
+
+            remaining--;
+            index = (index + 1 < _numWatches) ? index + 1 : 0;
+        }
+
+        if (selected != 0xFF)
+            credit = (credit > kSelectBits) ? credit - kSelectBits : 0;
+    }
+
+    return ticks;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// getWorstCaseLatency()
+//
+// A change made just after its device was probed is first seen within one sweep, and reported
+// after 'debounce' probes - allow one sweep more for the cursor position.
+
+uint32_t QwPCA9846HotPlug::getWorstCaseLatency()
+{
+    if ((_numWatches == 0) || (budgetBits() == 0))
+        return 0;
+
+    uint32_t ticksPerSweep = 0;
+    for (uint8_t start = 0; start < _numWatches; start++)
+    {
+        uint32_t ticks = sweepTicks(start);
+        if (ticks > ticksPerSweep)
+            ticksPerSweep = ticks;
+    }
+
+    return (uint32_t)(_debounce + 1) * ticksPerSweep;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// tick()
+//
+
+uint8_t QwPCA9846HotPlug::tick()
+{
+    sfe_PCA9846::QwIDeviceBus *bus = _mux.getCommunicationBus();
+
+    if (!bus || (_numWatches == 0))
+        return 0;
+
+    // Carry-over is capped at the budget - or, for a budget smaller than that, at the cost of one
+    // probe - so a tick never spends more than that
+    _credit += budgetBits();
+    if (_credit > maxCredit())
+        _credit = maxCredit();
+
+    // Without a valid cache, the selection is read before the first switch, so it can be put back
+    uint8_t previous = 0;
+    bool known = _mux.getCachedPortState(previous);
+    uint8_t selected = known ? previous : 0xFF;
+
+    uint8_t probed = 0;
+
+    for (uint8_t visited = 0; visited < _numWatches; visited++)
+    {
+        Watch &watch = _watches[_cursor];
+        uint8_t wanted = portBits(watch.portNumber);
+
+        // Isolated ports are skipped, free of charge
+        if (wanted & _mux.getIsolatedPorts())
+        {
+            _cursor = (_cursor + 1 < _numWatches) ? _cursor + 1 : 0;
+            continue;
+        }
+
+        uint32_t cost = kPingBits;
+        if (wanted != selected)
+            cost += kSelectBits;
+        if (!known)
+            cost += 2 * kSelectBits; // Read the selection, and keep enough back to restore it
+        else if (wanted != previous)
+            cost += kSelectBits; // Keep enough back to restore the selection
+
+        if (_credit < cost)
+            break;
+
+        if (!known)
+        {
+            _credit -= kSelectBits;
+            _bitsUsed += kSelectBits;
+
+            previous = _mux.getPortState();
+            if (previous == 254)
+                break;
+            known = true;
+            selected = previous;
+        }
+
+        if (wanted != selected)
+        {
+            _credit -= kSelectBits;
+            _bitsUsed += kSelectBits;
+
+            if (!_mux.setPortState(wanted))
+            {
+                selected = 0xFF;
+                break;
+            }
+            selected = wanted;
+        }
+
+        _credit -= kPingBits;
+        _bitsUsed += kPingBits;
+        _probes++;
+        probed++;
+
+        bool answered = bus->ping(watch.address);
+
+        if (answered == watch.present)
+        {
+            watch.streak = 0;
+        }
+        else if (++watch.streak >= _debounce)
+        {
+            watch.present = answered;
+            watch.streak = 0;
+
+            if (_callback)
+                _callback(watch.portNumber, watch.address, answered, _context);
+        }
+
+        _cursor = (_cursor + 1 < _numWatches) ? _cursor + 1 : 0;
+    }
+
+    if (known && (selected != previous))
+    {
+        _credit = (_credit > kSelectBits) ? _credit - kSelectBits : 0;
+        _bitsUsed += kSelectBits;
+        _mux.setPortState(previous);
+    }
+
+    return probed;
+}
@@ -0,0 +1,154 @@
+// sfe_pca9846_hotplug.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwPCA9846HotPlug class notices devices being plugged into, and pulled
+// out of, the mux ports - without a blocking rescan. It watches a list of
+// (port, address) pairs: the devices expected to be there, and candidates that
+// might appear. Each tick() pings a few of them, round-robin, within a bus-time
+// budget, so the monitor never takes more than its share of the bus from the
+// real traffic. A budget smaller than one probe is saved up over several ticks,
+// so the monitor still makes progress; a tick never uses more than the larger of
+// the budget and the cost of one probe.
+//
+// A device is reported attached (or detached) after the same answer has been
+// seen a number of probes in a row (setDebounce()), which filters out a
+// connector that bounces while it is being inserted. getWorstCaseLatency()
+// gives the longest time, in ticks, between a change and its event; use a larger
+// budget, or fewer watches, to bring it down.
+//
+// Bus time is estimated from the bit count of each transfer at the bus clock:
+// 11 bit times for a ping, 20 for a control register write.
+
+#pragma once
+
+#include "sfe_pca9846.h"
+
+// Maximum number of watched devices
+#ifndef SFE_PCA9846_HOTPLUG_MAX_WATCHES
+#define SFE_PCA9846_HOTPLUG_MAX_WATCHES 16
+#endif
+
+typedef void (*QwPCA9846HotPlugCallback)(uint8_t portNumber, uint8_t address, bool attached, void *context);
+
+class QwPCA9846HotPlug
+{
+public:
+    QwPCA9846HotPlug(QwDevPCA9846 &mux);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // watch()
+    //
+    // Add a device to watch.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  portNumber   The port (0-3), or SFE_PCA9846_TOPOLOGY_UPSTREAM
+    //  address      I2C address of the device
+    //  present      true for a device expected to be there, false for a candidate
+    //  retval       false if the list is full or the port is not valid
+
+    bool watch(uint8_t portNumber, uint8_t address, bool present = true);
+
+    // Watch every device in a discovered topology, as present
+    bool watch(const QwPCA9846Topology &topology);
+
+    bool unwatch(uint8_t portNumber, uint8_t address);
+
+    // Called from tick() for each attach / detach. It must not call watch() or unwatch()
+    void setCallback(QwPCA9846HotPlugCallback callback, void *context = nullptr);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // setBudget()
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  budgetMicros Bus time the monitor may use per tick, in microseconds
+    //  clockHz      The bus clock. 0 = use the mux clock profile (QwDevPCA9846::getClock())
+    //               or, if that is not known, SFE_PCA9846_DEFAULT_CLOCK
+
+    void setBudget(uint32_t budgetMicros, uint32_t clockHz = 0);
+
+    // Probes in a row which must agree before a change is reported. Default 2
+    void setDebounce(uint8_t probes) { _debounce = probes > 0 ? probes : 1; }
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // tick()
+    //
+    // Probe as many watched devices as the budget allows. The port selection is
+    // restored afterwards (if the mux cache knows it), and the restore is paid for
+    // out of the budget too.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  retval       Number of devices probed
+
+    uint8_t tick();
+
+    bool isPresent(uint8_t portNumber, uint8_t address);
+
+    // Longest delay between a device changing and its event, in ticks. 0 = no watches, or no budget
+    uint32_t getWorstCaseLatency();
+
+    uint32_t getProbes() { return _probes; }
+    uint32_t getBusMicros(); // Estimated bus time used since construction
+
+private:
+    struct Watch
+    {
+        uint8_t portNumber;
+        uint8_t address;
+        bool present;   // State as reported
+        uint8_t streak; // Probes in a row which disagreed with 'present'
+    };
+
+    uint8_t portBits(uint8_t portNumber) { return portNumber == SFE_PCA9846_TOPOLOGY_UPSTREAM ? 0 : 1 << portNumber; }
+
+    // Bus clock for the cost estimate
+    uint32_t clock();
+
+    // The budget per tick, and the most a tick may spend, in bit times
+    uint32_t budgetBits();
+    uint32_t maxCredit();
+
+    // Ticks a sweep of the whole watch list takes, at worst, starting at a given watch
+    uint32_t sweepTicks(uint8_t start);
+
+    QwDevPCA9846 &_mux;
+
+    Watch _watches[SFE_PCA9846_HOTPLUG_MAX_WATCHES]; // Kept in port order, to keep port switches down
+    uint8_t _numWatches;
+    uint8_t _cursor;
+
+    QwPCA9846HotPlugCallback _callback;
+    void *_context;
+
+    uint32_t _budgetMicros;
+    uint32_t _clockHz;
+    uint8_t _debounce;
+
+    uint32_t _credit; // Unspent budget, in bit times
+    uint32_t _probes;
+    uint32_t _bitsUsed;
+};
@@ -0,0 +1,260 @@
+// sfe_pca9846_poller.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Multi-rate polling of downstream devices. See sfe_pca9846_poller.h
+
+#include "sfe_pca9846_poller.h"
+
+#if (SFE_PCA9846_POLLER_RING_SIZE & (SFE_PCA9846_POLLER_RING_SIZE - 1)) || (SFE_PCA9846_POLLER_RING_SIZE > 128)
+#error "SFE_PCA9846_POLLER_RING_SIZE must be a power of two, no more than 128"
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// QwPCA9846PollRing
+//
+// The indices are single bytes, so loads and stores are atomic on every target. The acquire /
+// release ordering makes the slot contents visible before the index which publishes them, on
+// multi-core targets as well.
+
+QwPCA9846PollResult *QwPCA9846PollRing::reserve()
+{
+    uint8_t tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+
+    if ((uint8_t)(_head - tail) >= SFE_PCA9846_POLLER_RING_SIZE)
+        return nullptr;
+
+    return &_slots[_head & (SFE_PCA9846_POLLER_RING_SIZE - 1)];
+}
+
+void QwPCA9846PollRing::commit()
+{
+    __atomic_store_n(&_head, (uint8_t)(_head + 1), __ATOMIC_RELEASE);
+}
+
+bool QwPCA9846PollRing::pop(QwPCA9846PollResult &result)
+{
+    uint8_t head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+
+    if (head == _tail)
+        return false;
+
+    result = _slots[_tail & (SFE_PCA9846_POLLER_RING_SIZE - 1)];
+
+    __atomic_store_n(&_tail, (uint8_t)(_tail + 1), __ATOMIC_RELEASE);
+    return true;
+}
+
+uint8_t QwPCA9846PollRing::available()
+{
+    return (uint8_t)(__atomic_load_n(&_head, __ATOMIC_ACQUIRE) - __atomic_load_n(&_tail, __ATOMIC_ACQUIRE));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor
+//
+
+QwPCA9846Poller::QwPCA9846Poller(QwDevPCA9846 &mux) : _mux{mux}
+{
+    for (uint8_t i = 0; i < SFE_PCA9846_POLLER_MAX_JOBS; i++)
+        _jobs[i].inUse = false;
+
+    resetStats();
+}
+
+void QwPCA9846Poller::resetStats()
+{
+    _jobsRun = 0;
+    _switches = 0;
+    _dropped = 0;
+    _overruns = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// addJob()
+//
+
+uint8_t QwPCA9846Poller::addJob(uint8_t portNumber, uint8_t address, uint8_t reg, uint8_t length, uint32_t period)
+{
+    if ((portNumber > 3) || (length == 0) || (length > SFE_PCA9846_POLLER_MAX_DATA))
+        return SFE_PCA9846_POLLER_NO_JOB;
+
+    for (uint8_t i = 0; i < SFE_PCA9846_POLLER_MAX_JOBS; i++)
+    {
+        Job &job = _jobs[i];
+
+        if (job.inUse)
+            continue;
+
+        job.period = period;
+        job.nextDue = 0;
+        job.portNumber = portNumber;
+        job.address = address;
+        job.reg = reg;
+        job.length = length;
+        job.inUse = true;
+        job.enabled = true;
+        job.started = false;
+
+        return i;
+    }
+
+    return SFE_PCA9846_POLLER_NO_JOB;
+}
+
+bool QwPCA9846Poller::removeJob(uint8_t job)
+{
+    if ((job >= SFE_PCA9846_POLLER_MAX_JOBS) || !_jobs[job].inUse)
+        return false;
+
+    _jobs[job].inUse = false;
+    return true;
+}
+
+bool QwPCA9846Poller::enableJob(uint8_t job, bool enable)
+{
+    if ((job >= SFE_PCA9846_POLLER_MAX_JOBS) || !_jobs[job].inUse)
+        return false;
+
+    _jobs[job].enabled = enable;
+    _jobs[job].started = false;
+    return true;
+}
+
+bool QwPCA9846Poller::isDue(const Job &job, uint32_t now)
+{
+    if (!job.inUse || !job.enabled)
+        return false;
+
+    // The subtraction handles the time wrapping
+    return !job.started || ((int32_t)(now - job.nextDue) >= 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// reschedule()
+//
+// Keep the job on its original time grid, unless a whole period was missed - then restart the
+// grid from now, rather than running the job several times back to back to catch up.
+
+void QwPCA9846Poller::reschedule(Job &job, uint32_t now)
+{
+    if (!job.started)
+    {
+        job.nextDue = now + job.period;
+        job.started = true;
+        return;
+    }
+
+    job.nextDue += job.period;
+
+    if ((int32_t)(now - job.nextDue) >= 0)
+    {
+        _overruns++;
+        job.nextDue = now + job.period;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// selectedPort()
+//
+// The port the mux cache says is selected on its own. 0xFF if unknown
+
+uint8_t QwPCA9846Poller::selectedPort()
+{
+    uint8_t portBits;
+    if (!_mux.getCachedPortState(portBits))
+        return 0xFF;
+
+    for (uint8_t port = 0; port < 4; port++)
+    {
+        if (portBits == (1 << port))
+            return port;
+    }
+
+    return 0xFF;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// service()
+//
+// Visit the ports in turn, starting with the selected one, and run every due job on each.
+
+uint8_t QwPCA9846Poller::service(uint32_t now)
+{
+    sfe_PCA9846::QwIDeviceBus *bus = _mux.getCommunicationBus();
+    if (!bus)
+        return 0;
+
+    uint8_t run = 0;
+    uint8_t currentPort = selectedPort();
+    uint8_t firstPort = (currentPort <= 3) ? currentPort : 0;
+
+    for (uint8_t p = 0; p < 4; p++)
+    {
+        uint8_t portNumber = (firstPort + p) & 3;
+
+        for (uint8_t i = 0; i < SFE_PCA9846_POLLER_MAX_JOBS; i++)
+        {
+            Job &job = _jobs[i];
+
+            if ((job.portNumber != portNumber) || !isDue(job, now))
+                continue;
+
+            QwPCA9846PollResult *result = _ring.reserve();
+
+            if (!result)
+            {
+                _dropped++;
+                reschedule(job, now);
+                continue;
+            }
+
+            // setPort() costs nothing if the cache says the port is selected already
+            bool switching = portNumber != selectedPort();
+            bool success = _mux.setPort(portNumber);
+
+            if (success && switching)
+                _switches++;
+
+            if (success)
+                success = bus->readRegisterRegion(job.address, job.reg, result->data, job.length);
+
+            result->timestamp = now;
+            result->job = i;
+            result->portNumber = portNumber;
+            result->address = job.address;
+            result->reg = job.reg;
+            result->length = job.length;
+            result->success = success;
+
+            _ring.commit();
+
+            reschedule(job, now);
+            _jobsRun++;
+            run++;
+        }
+    }
+
+    return run;
+}
@@ -0,0 +1,182 @@
+// sfe_pca9846_poller.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwPCA9846Poller class polls downstream sensors at their own rates. Each
+// job is a register read - port, address, register, length - repeated every
+// period. service() runs the jobs which are due, grouped by mux port, starting
+// with the port which is already selected, so each port is selected at most once
+// per call.
+//
+// Every job selects its port with QwDevPCA9846::setPort(), so the mux may also be
+// used directly in between. With the mux cache enabled (enableCache()), the
+// selection is only written when it changes.
+//
+// Results go into a QwPCA9846PollRing: a fixed-size, single producer / single
+// consumer ring buffer. service() is the producer; the consumer can be the main
+// loop, or an interrupt / another task. Neither side blocks the other, and
+// nothing is allocated after construction. When the ring is full, due jobs are
+// skipped (without touching the bus) and counted as dropped.
+
+#pragma once
+
+#include "sfe_pca9846.h"
+
+// Maximum number of jobs
+#ifndef SFE_PCA9846_POLLER_MAX_JOBS
+#define SFE_PCA9846_POLLER_MAX_JOBS 8
+#endif
+
+// Maximum bytes read by one job
+#ifndef SFE_PCA9846_POLLER_MAX_DATA
+#define SFE_PCA9846_POLLER_MAX_DATA 8
+#endif
+
+// Results held by the ring. Must be a power of two, no more than 128
+#ifndef SFE_PCA9846_POLLER_RING_SIZE
+#define SFE_PCA9846_POLLER_RING_SIZE 16
+#endif
+
+// Returned by addJob() when the job table is full or the job is invalid
+#define SFE_PCA9846_POLLER_NO_JOB 0xFF
+
+struct QwPCA9846PollResult
+{
+    uint32_t timestamp; // The 'now' passed to service()
+    uint8_t job;        // Job number, as returned by addJob()
+    uint8_t portNumber;
+    uint8_t address;
+    uint8_t reg;
+    uint8_t length;
+    bool success;
+    uint8_t data[SFE_PCA9846_POLLER_MAX_DATA];
+};
+
+class QwPCA9846PollRing
+{
+public:
+    QwPCA9846PollRing() : _head{0}, _tail{0}
+    {
+    }
+
+    // Producer side. Reserve the next slot, fill it in, then commit it.
+    // Returns nullptr if the ring is full
+    QwPCA9846PollResult *reserve();
+    void commit();
+
+    // Consumer side. Returns false if the ring is empty
+    bool pop(QwPCA9846PollResult &result);
+
+    uint8_t available();
+
+    bool isEmpty() { return available() == 0; }
+
+private:
+    QwPCA9846PollResult _slots[SFE_PCA9846_POLLER_RING_SIZE];
+
+    // Free-running indices. _head is only written by the producer, _tail by the consumer
+    uint8_t _head;
+    uint8_t _tail;
+};
+
+class QwPCA9846Poller
+{
+public:
+    QwPCA9846Poller(QwDevPCA9846 &mux);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // addJob()
+    //
+    // Register a periodic register read. The first read is due at the first service().
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  portNumber   Mux port the device is attached to (0-3)
+    //  address      I2C address of the device
+    //  reg          Register to read from
+    //  length       Number of bytes (1 to SFE_PCA9846_POLLER_MAX_DATA)
+    //  period       Time between reads, in the units passed to service() (e.g. ms)
+    //  retval       The job number, or SFE_PCA9846_POLLER_NO_JOB
+
+    uint8_t addJob(uint8_t portNumber, uint8_t address, uint8_t reg, uint8_t length, uint32_t period);
+
+    bool removeJob(uint8_t job);
+
+    // Suspend / resume a job. A resumed job is due immediately
+    bool enableJob(uint8_t job, bool enable = true);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // service()
+    //
+    // Run the jobs which are due. Call it often - from loop(), for example.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  now          The current time, e.g. millis(). Allowed to wrap
+    //  retval       Number of jobs run
+
+    uint8_t service(uint32_t now);
+
+    // The results. Consume them with getResults().pop()
+    QwPCA9846PollRing &getResults() { return _ring; }
+
+    uint32_t getJobsRun() { return _jobsRun; }
+    uint32_t getSwitches() { return _switches; } // Selection writes which were needed and succeeded
+    uint32_t getDropped() { return _dropped; }  // Skipped because the ring was full
+    uint32_t getOverruns() { return _overruns; } // A whole period or more was missed
+
+    void resetStats();
+
+private:
+    struct Job
+    {
+        uint32_t period;
+        uint32_t nextDue;
+        uint8_t portNumber;
+        uint8_t address;
+        uint8_t reg;
+        uint8_t length;
+        bool inUse;
+        bool enabled;
+        bool started; // nextDue has been set
+    };
+
+    bool isDue(const Job &job, uint32_t now);
+
+    // Move a job's due time on after a run (or a skip)
+    void reschedule(Job &job, uint32_t now);
+
+    // The port the mux cache says is selected on its own. 0xFF if unknown
+    uint8_t selectedPort();
+
+    QwDevPCA9846 &_mux;
+    QwPCA9846PollRing _ring;
+
+    Job _jobs[SFE_PCA9846_POLLER_MAX_JOBS];
+
+    uint32_t _jobsRun;
+    uint32_t _switches;
+    uint32_t _dropped;
+    uint32_t _overruns;
+};
@@ -0,0 +1,202 @@
+// sfe_pca9846_production.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Production test of the PCA9846 board. See sfe_pca9846_production.h
+
+#include "sfe_pca9846_production.h"
+
+#if defined(ARDUINO)
+static uint32_t arduinoMicros(void)
+{
+    return micros();
+}
+#endif
+
+void QwPCA9846TestRecord::pack(uint8_t *buffer) const
+{
+    *buffer++ = (uint8_t)sequence;
+    *buffer++ = (uint8_t)(sequence >> 8);
+    *buffer++ = result;
+    *buffer++ = failedPorts;
+
+    for (uint8_t i = 0; i < kQwStageCount; i++)
+    {
+        *buffer++ = (uint8_t)stageMicros[i];
+        *buffer++ = (uint8_t)(stageMicros[i] >> 8);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor
+//
+
+QwPCA9846ProductionTest::QwPCA9846ProductionTest(QwDevPCA9846 &mux)
+    : _mux{mux}, _micros{nullptr}, _probeAddress{SFE_PCA9846_TEST_DEFAULT_PROBE}, _stageStart{0}, _sequence{0}, _passed{0}, _failed{0}
+{
+#if defined(ARDUINO)
+    _micros = arduinoMicros;
+#endif
+}
+
+bool QwPCA9846ProductionTest::isBoardPresent()
+{
+    sfe_PCA9846::QwIDeviceBus *bus = _mux.getCommunicationBus();
+
+    return bus && bus->ping(_mux.getAddress());
+}
+
+bool QwPCA9846ProductionTest::endStage(QwPCA9846TestStage stage, QwPCA9846TestRecord &record, bool passed)
+{
+    uint32_t elapsed = now() - _stageStart;
+
+    // A stage which ran always records at least 1us, so 0 means 'not run'
+    if (elapsed == 0)
+        elapsed = 1;
+    record.stageMicros[stage] = (elapsed > 0xFFFF) ? 0xFFFF : (uint16_t)elapsed;
+
+    return passed;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// testLatch()
+//
+// Each port bit on its own, then all four together. The cache is bypassed: every value is written
+// and read back on the bus. Stops at the first failure - a shorted port which is connected can
+// take the whole bus down, and then every later pattern would fail too. Returns the bits of the
+// failing pattern which did not read back.
+
+uint8_t QwPCA9846ProductionTest::testLatch()
+{
+    uint8_t failed = 0;
+
+    for (uint8_t pattern = 0; pattern < 5; pattern++)
+    {
+        uint8_t portBits = (pattern < 4) ? (1 << pattern) : 0x0F;
+        uint8_t readBack = 0xFF;
+
+        _mux.invalidateCache();
+
+        if (!_mux.setPortState(portBits) || !_mux.read(&readBack) || (readBack != portBits))
+        {
+            // Which bits were wrong? If nothing could be read, blame all of them
+            failed = (readBack == 0xFF) ? portBits : (uint8_t)((readBack ^ portBits) & 0x0F);
+            break;
+        }
+    }
+
+    _mux.invalidateCache();
+    _mux.setPortState(0);
+
+    return failed;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// testShorts()
+//
+// Connect each port on its own and ping the probe address. The only good answer is an address
+// NACK. A port which will not let go of the bus stops the test: with it holding SDA low,
+// every later port would fail too. Returns the faulty ports.
+
+uint8_t QwPCA9846ProductionTest::testShorts()
+{
+    sfe_PCA9846::QwIDeviceBus *bus = _mux.getCommunicationBus();
+    uint8_t failed = 0;
+
+    for (uint8_t port = 0; port < 4; port++)
+    {
+        _mux.invalidateCache();
+
+        if (!_mux.setPortState(1 << port))
+        {
+            failed |= 1 << port;
+            continue;
+        }
+
+        if (bus->ping(_probeAddress) || (bus->getLastError() != SFE_PCA9846_BUS_ERROR_ADDR_NACK))
+            failed |= 1 << port;
+
+        _mux.invalidateCache();
+        if (!_mux.setPortState(0))
+        {
+            failed |= 1 << port;
+            break;
+        }
+    }
+
+    return failed;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// run()
+//
+
+bool QwPCA9846ProductionTest::run(QwPCA9846TestRecord &record)
+{
+    record.sequence = _sequence++;
+    record.result = kQwTestPass;
+    record.failedPorts = 0;
+    for (uint8_t i = 0; i < kQwStageCount; i++)
+        record.stageMicros[i] = 0;
+
+    if (!_mux.getCommunicationBus())
+        record.result = kQwTestNoBus;
+
+    if (record.result == kQwTestPass)
+    {
+        beginStage();
+        if (!endStage(kQwStageDetect, record, isBoardPresent()))
+            record.result = kQwTestNoDevice;
+    }
+
+    if (record.result == kQwTestPass)
+    {
+        beginStage();
+        if (!endStage(kQwStageId, record, _mux.getUniqueId() == SFE_PCA9846_MUX_DEVICE_ID))
+            record.result = kQwTestBadId;
+    }
+
+    if (record.result == kQwTestPass)
+    {
+        beginStage();
+        record.failedPorts = testLatch();
+        if (!endStage(kQwStageLatch, record, record.failedPorts == 0))
+            record.result = kQwTestLatch;
+    }
+
+    if (record.result == kQwTestPass)
+    {
+        beginStage();
+        record.failedPorts = testShorts();
+        if (!endStage(kQwStageShort, record, record.failedPorts == 0))
+            record.result = kQwTestShort;
+    }
+
+    if (record.result == kQwTestPass)
+        _passed++;
+    else
+        _failed++;
+
+    return record.result == kQwTestPass;
+}
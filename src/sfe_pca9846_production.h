@@ -0,0 +1,141 @@
+// sfe_pca9846_production.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwPCA9846ProductionTest class is the board test used on the production
+// line. It runs four stages back to back, with no fixed delays:
+//
+//  1. Detect     - the mux ACKs its address
+//  2. ID         - the Device ID read from 0x7C is 0x000858
+//  3. Latch      - each port bit, then all four, latch and read back correctly
+//  4. Short      - with each port connected on its own, an unused address NACKs.
+//                  A port whose SDA is held low ACKs everything; one whose SCL
+//                  is held low makes the transfer fail outright. The bus must
+//                  report the NACK as SFE_PCA9846_BUS_ERROR_ADDR_NACK, which
+//                  some Linux adapters do not (see sfe_linux_i2c.h)
+//
+// The result is a QwPCA9846TestRecord: a failure code, the failing ports, and
+// the time spent in each stage. pack() turns it into a fixed 12-byte record for
+// the fixture PC to log.
+
+#pragma once
+
+#include "sfe_pca9846.h"
+
+// Size of a packed QwPCA9846TestRecord
+#define SFE_PCA9846_TEST_RECORD_SIZE 12
+
+// Used by the short test unless setProbeAddress() is called. Reserved (CBUS)
+// address - nothing on a fixture should answer it
+#define SFE_PCA9846_TEST_DEFAULT_PROBE 0x01
+
+enum QwPCA9846TestResult
+{
+    kQwTestPass = 0,
+    kQwTestNoDevice, // Nothing ACKed the mux address
+    kQwTestBadId,    // The Device ID could not be read, or is wrong
+    kQwTestLatch,    // Port bits did not read back. failedPorts says which
+    kQwTestShort,    // Downstream bus fault. failedPorts says which
+    kQwTestNoBus     // No communication bus
+};
+
+enum QwPCA9846TestStage
+{
+    kQwStageDetect = 0,
+    kQwStageId,
+    kQwStageLatch,
+    kQwStageShort,
+    kQwStageCount
+};
+
+struct QwPCA9846TestRecord
+{
+    uint16_t sequence;     // Incremented for every test run
+    uint8_t result;        // QwPCA9846TestResult
+    uint8_t failedPorts;   // Bit n = port n
+    uint16_t stageMicros[kQwStageCount]; // 0 = stage not run. Saturates at 65535
+
+    // Little-endian: sequence, result, failedPorts, then the stage times
+    void pack(uint8_t *buffer) const;
+};
+
+class QwPCA9846ProductionTest
+{
+public:
+    // Returns a free-running microsecond count
+    typedef uint32_t (*MicrosFunction)(void);
+
+    QwPCA9846ProductionTest(QwDevPCA9846 &mux);
+
+    // micros() is used by default on Arduino. Without a time source, the stage times are 0
+    void setMicrosFunction(MicrosFunction microsFunction) { _micros = microsFunction; }
+
+    // The address pinged by the short test. It must not be used by anything on the fixture
+    void setProbeAddress(uint8_t address) { _probeAddress = address; }
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // isBoardPresent()
+    //
+    // A single ping of the mux address. Use it to wait for a board to be inserted,
+    // and removed again, between tests.
+
+    bool isBoardPresent();
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // run()
+    //
+    // Test the board. Stops at the first stage which fails. All ports are
+    // disconnected afterwards.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  record       Filled in with the results
+    //  retval       true if the board passed
+
+    bool run(QwPCA9846TestRecord &record);
+
+    uint16_t getPassed() { return _passed; }
+    uint16_t getFailed() { return _failed; }
+
+private:
+    uint32_t now() { return _micros ? _micros() : 0; }
+
+    // Start the timer for a stage
+    void beginStage() { _stageStart = now(); }
+
+    // Stop the timer. Returns passed, so it can wrap the stage
+    bool endStage(QwPCA9846TestStage stage, QwPCA9846TestRecord &record, bool passed);
+
+    uint8_t testLatch();
+    uint8_t testShorts();
+
+    QwDevPCA9846 &_mux;
+    MicrosFunction _micros;
+    uint8_t _probeAddress;
+
+    uint32_t _stageStart;
+    uint16_t _sequence;
+    uint16_t _passed;
+    uint16_t _failed;
+};
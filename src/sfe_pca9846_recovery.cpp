@@ -0,0 +1,240 @@
+// sfe_pca9846_recovery.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Downstream fault recovery and isolation. See sfe_pca9846_recovery.h
+
+#include "sfe_pca9846_recovery.h"
+
+#if defined(ARDUINO)
+static void arduinoDelay(uint32_t milliseconds)
+{
+    delay(milliseconds);
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor
+//
+
+QwPCA9846Recovery::QwPCA9846Recovery(QwDevPCA9846 &mux)
+    : _mux{mux}, _hook{nullptr}, _hookContext{nullptr}, _delay{nullptr}, _maxAttempts{3}, _firstDelayMs{1}, _maxDelayMs{50}, _tests{0}
+{
+#if defined(ARDUINO)
+    _delay = arduinoDelay;
+#endif
+}
+
+void QwPCA9846Recovery::setRecoveryHook(RecoveryHook hook, void *context)
+{
+    _hook = hook;
+    _hookContext = context;
+}
+
+void QwPCA9846Recovery::setRetryPolicy(uint8_t maxAttempts, uint16_t firstDelayMs, uint16_t maxDelayMs)
+{
+    _maxAttempts = maxAttempts > 0 ? maxAttempts : 1;
+    _firstDelayMs = firstDelayMs;
+    _maxDelayMs = maxDelayMs;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// recoverBus()
+//
+// Try to disconnect everything first - if the fault is not holding the bus, that is all it
+// takes. Otherwise run the hook and try again. The cache is dropped first: after a fault it
+// may claim the ports are already off, and the write would be skipped.
+
+bool QwPCA9846Recovery::recoverBus()
+{
+    uint8_t isolated = _mux.getIsolatedPorts();
+    _mux.isolatePorts(0);
+
+    _mux.invalidateCache();
+    bool recovered = _mux.setPortState(0);
+
+    if (!recovered && _hook && _hook(_hookContext))
+    {
+        _mux.invalidateCache();
+        recovered = _mux.setPortState(0);
+    }
+
+    // Confirm with a fresh read
+    recovered = recovered && _mux.resync() && (_mux.getPortState() == 0);
+
+    _mux.isolatePorts(isolated);
+    return recovered;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// retry()
+//
+
+bool QwPCA9846Recovery::retry(Operation operation, void *context)
+{
+    uint32_t delayMs = _firstDelayMs;
+
+    for (uint8_t attempt = 0; attempt < _maxAttempts; attempt++)
+    {
+        if (attempt > 0)
+        {
+            if (_delay && (delayMs > 0))
+                _delay(delayMs);
+
+            delayMs *= 2;
+            if (delayMs > _maxDelayMs)
+                delayMs = _maxDelayMs;
+
+            // Whatever went wrong may still be holding the bus
+            recoverBus();
+        }
+
+        if (operation(_mux, context))
+            return true;
+    }
+
+    return false;
+}
+
+bool QwPCA9846Recovery::testPorts(uint8_t portMask)
+{
+    _tests++;
+
+    bool passed = _mux.setPortState(portMask) && _mux.resync() && (_mux.getPortState() == portMask);
+
+    // Disconnect again, always with a real write. If the ports are holding the bus, that needs the hook
+    _mux.invalidateCache();
+    if (!_mux.setPortState(0))
+    {
+        passed = false;
+        recoverBus();
+    }
+
+    return passed;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// bisect()
+//
+// knownFaulty: the caller has already seen this group fail, so testing it again is pointless.
+// With one faulty port among four, this takes four tests or fewer.
+
+uint8_t QwPCA9846Recovery::bisect(uint8_t portMask, bool knownFaulty)
+{
+    if (portMask == 0)
+        return 0;
+
+    if (!knownFaulty && testPorts(portMask))
+        return 0;
+
+    // A single port: it is the faulty one
+    if ((portMask & (portMask - 1)) == 0)
+        return portMask;
+
+    // Split the ports into two halves
+    uint8_t low = 0;
+    uint8_t count = 0;
+    for (uint8_t port = 0; port < 4; port++)
+    {
+        if (portMask & (1 << port))
+            count++;
+    }
+    for (uint8_t port = 0, taken = 0; (port < 4) && (taken < count / 2); port++)
+    {
+        if (portMask & (1 << port))
+        {
+            low |= 1 << port;
+            taken++;
+        }
+    }
+    uint8_t high = portMask & ~low;
+
+    uint8_t faulty = bisect(low, false);
+
+    // If the low half passed, the fault must be in the high half
+    faulty |= bisect(high, faulty == 0);
+
+    return faulty;
+}
+
+uint8_t QwPCA9846Recovery::findFaultyPorts(uint8_t candidates)
+{
+    uint8_t isolated = _mux.getIsolatedPorts();
+    _mux.isolatePorts(0);
+
+    uint8_t faulty = bisect(candidates & 0x0F, false);
+
+    _mux.isolatePorts(isolated);
+    return faulty;
+}
+
+uint8_t QwPCA9846Recovery::isolateFaultyPorts()
+{
+    if (!recoverBus())
+        return 0xFF;
+
+    uint8_t faulty = findFaultyPorts(0x0F);
+    _mux.isolatePorts(faulty);
+
+    return faulty;
+}
+
+#if defined(ARDUINO)
+namespace sfe_PCA9846
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // clockOutBus()
+    //
+    // Lines are driven open-drain style: released by switching to INPUT_PULLUP, pulled low by
+    // switching to OUTPUT LOW
+
+    bool clockOutBus(uint8_t sdaPin, uint8_t sclPin)
+    {
+        pinMode(sdaPin, INPUT_PULLUP);
+        pinMode(sclPin, INPUT_PULLUP);
+        delayMicroseconds(5);
+
+        for (uint8_t i = 0; (i < 9) && (digitalRead(sdaPin) == LOW); i++)
+        {
+            pinMode(sclPin, OUTPUT);
+            digitalWrite(sclPin, LOW);
+            delayMicroseconds(5);
+            pinMode(sclPin, INPUT_PULLUP);
+            delayMicroseconds(5);
+        }
+
+        if (digitalRead(sdaPin) == LOW)
+            return false;
+
+        // STOP: SDA low to high while SCL is high
+        pinMode(sdaPin, OUTPUT);
+        digitalWrite(sdaPin, LOW);
+        delayMicroseconds(5);
+        pinMode(sdaPin, INPUT_PULLUP);
+        delayMicroseconds(5);
+
+        return digitalRead(sdaPin) == HIGH;
+    }
+}
+#endif
@@ -0,0 +1,163 @@
+// sfe_pca9846_recovery.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwPCA9846Recovery class gets a mux working again after a downstream bus
+// fault - a shorted port, or a device holding SDA low. While a faulty port is
+// connected, every transfer on the upstream bus fails, including the ones to
+// the mux itself, so the engine combines:
+//
+//  - an upstream bus recovery hook, supplied by the application: clock SCL until
+//    SDA is released (see clockOutBus()), pulse the mux RESET pin, or both
+//  - retries with bounded exponential backoff
+//  - a bisection over port masks which finds the faulty port(s) in a few
+//    enable / read back tests
+//  - isolation of the faulty ports (QwDevPCA9846::isolatePorts()), so the other
+//    ports keep working
+
+#pragma once
+
+#include "sfe_pca9846.h"
+
+class QwPCA9846Recovery
+{
+public:
+    // Recover the upstream bus. Return true if the bus is usable again
+    typedef bool (*RecoveryHook)(void *context);
+
+    // Wait for a number of milliseconds
+    typedef void (*DelayFunction)(uint32_t milliseconds);
+
+    // An operation to retry. Return true on success
+    typedef bool (*Operation)(QwDevPCA9846 &mux, void *context);
+
+    QwPCA9846Recovery(QwDevPCA9846 &mux);
+
+    void setRecoveryHook(RecoveryHook hook, void *context = nullptr);
+
+    // delay() is used by default on Arduino. Without a delay function, retries are back to back
+    void setDelayFunction(DelayFunction delayFunction) { _delay = delayFunction; }
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // setRetryPolicy()
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  maxAttempts  Attempts made by retry(), including the first
+    //  firstDelayMs Wait before the second attempt. Doubled for each further attempt
+    //  maxDelayMs   Longest wait between attempts
+
+    void setRetryPolicy(uint8_t maxAttempts, uint16_t firstDelayMs, uint16_t maxDelayMs);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // recoverBus()
+    //
+    // Run the recovery hook, disconnect every port, and check the mux answers.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  retval       true if the mux is reachable with all ports disconnected
+
+    bool recoverBus();
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // retry()
+    //
+    // Run an operation, recovering the bus and backing off between failed attempts.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  operation    The operation
+    //  context      Passed through to the operation
+    //  retval       true if an attempt succeeded
+
+    bool retry(Operation operation, void *context = nullptr);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // findFaultyPorts()
+    //
+    // Bisect the candidate ports: a group of ports is enabled together and the control
+    // register read back. Groups which pass are cleared in one go; groups which fail
+    // are split in half. Leaves all ports disconnected.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  candidates   Ports to test (bit n = port n)
+    //  retval       The faulty ports
+
+    uint8_t findFaultyPorts(uint8_t candidates = 0x0F);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // isolateFaultyPorts()
+    //
+    // Recover the bus, find the faulty ports and isolate them. Ports isolated before
+    // are tested again and returned to service if they now pass.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  retval       The ports now isolated, or 0xFF if the bus could not be recovered
+
+    uint8_t isolateFaultyPorts();
+
+    // Port tests run by findFaultyPorts(), since construction
+    uint32_t getTests() { return _tests; }
+
+private:
+    // Enable portMask, check the control register reads back, then disconnect again
+    bool testPorts(uint8_t portMask);
+
+    uint8_t bisect(uint8_t portMask, bool knownFaulty);
+
+    QwDevPCA9846 &_mux;
+
+    RecoveryHook _hook;
+    void *_hookContext;
+    DelayFunction _delay;
+
+    uint8_t _maxAttempts;
+    uint16_t _firstDelayMs;
+    uint16_t _maxDelayMs;
+
+    uint32_t _tests;
+};
+
+#if defined(ARDUINO)
+namespace sfe_PCA9846
+{
+    //////////////////////////////////////////////////////////////////////////////////
+    // clockOutBus()
+    //
+    // Standard I2C bus clear: with the I2C peripheral stopped (e.g. Wire.end()), clock
+    // SCL up to nine times until the device holding SDA low lets go, then send a STOP.
+    // Restart the I2C peripheral afterwards (e.g. Wire.begin()).
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  sdaPin       The SDA pin
+    //  sclPin       The SCL pin
+    //  retval       true if SDA was released
+
+    bool clockOutBus(uint8_t sdaPin, uint8_t sclPin);
+};
+#endif
@@ -0,0 +1,155 @@
+// sfe_pca9846_replay.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Replay of recorded bus traces. See sfe_pca9846_replay.h
+
+#include "sfe_pca9846_replay.h"
+#include <string.h>
+
+using namespace sfe_PCA9846;
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor
+//
+
+QwPCA9846TraceReplayer::QwPCA9846TraceReplayer(QwDevPCA9846 &mux) : _mux{mux}
+{
+}
+
+bool QwPCA9846TraceReplayer::replay(const uint8_t *trace, uint32_t size, QwPCA9846ReplayStats &stats)
+{
+    memset(&stats, 0, sizeof(stats));
+
+    if (!_mux.getCommunicationBus())
+        return false;
+
+    QwTraceReader reader(trace, size);
+    if (!reader.isValid())
+        return false;
+
+    QwTraceRecord record;
+
+    while (reader.next(record))
+    {
+        stats.records++;
+        stats.recordedMicros += record.deltaMicros;
+
+        if (replayRecord(record, stats))
+            stats.replayed++;
+        else
+            stats.skipped++;
+    }
+
+    // Stopped before the end: the trace is corrupt
+    return reader.atEnd();
+}
+
+void QwPCA9846TraceReplayer::compare(const uint8_t *data, uint16_t length, const uint8_t *recorded, uint16_t recordedLength,
+                                     QwPCA9846ReplayStats &stats)
+{
+    // Only the stored part of the payload can be compared
+    uint16_t count = (recordedLength < length) ? recordedLength : length;
+
+    if (memcmp(data, recorded, count) != 0)
+        stats.dataMismatches++;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// replayRecord()
+//
+
+bool QwPCA9846TraceReplayer::replayRecord(const QwTraceRecord &record, QwPCA9846ReplayStats &stats)
+{
+    QwIDeviceBus *bus = _mux.getCommunicationBus();
+    bool isMux = record.address == _mux.getAddress();
+    bool wasGood = record.status == SFE_PCA9846_BUS_OK;
+    bool success = false;
+    uint8_t buffer[SFE_PCA9846_REPLAY_BUFFER];
+
+    switch (record.op)
+    {
+    case kQwTracePing:
+        success = bus->ping(record.address);
+        break;
+
+    case kQwTraceWrite:
+        if (record.payloadLength < 1)
+            return false;
+
+        success = isMux ? _mux.setPortState(record.payload[0]) : bus->write(record.address, record.payload[0]);
+        break;
+
+    case kQwTraceWriteRegisterRegion:
+        if (record.truncated)
+            return false;
+
+        success = bus->writeRegisterRegion(record.address, record.offset, record.payload, record.length);
+        if (isMux)
+            _mux.invalidateCache();
+        break;
+
+    case kQwTraceRead:
+        success = isMux ? _mux.read(buffer) : bus->read(record.address, buffer);
+        if (success && wasGood)
+            compare(buffer, 1, record.payload, record.payloadLength, stats);
+        break;
+
+    case kQwTraceReadRegisterRegion:
+        if (record.length > sizeof(buffer))
+            return false;
+
+        success = bus->readRegisterRegion(record.address, record.offset, buffer, (uint8_t)record.length);
+        if (isMux)
+            _mux.invalidateCache();
+        if (success && wasGood)
+            compare(buffer, record.length, record.payload, record.payloadLength, stats);
+        break;
+
+    case kQwTraceTransfer:
+        if ((record.payloadLength < record.length) || (record.rxLength > sizeof(buffer)))
+            return false;
+
+        success = bus->transfer(record.address, record.payload, record.length, buffer, record.rxLength);
+        if (success && wasGood)
+            compare(buffer, record.rxLength, record.payload + record.length, record.payloadLength - record.length, stats);
+        break;
+
+    case kQwTraceSetClock:
+        if (record.payloadLength < 4)
+            return false;
+
+        success = bus->setClock((uint32_t)record.payload[0] | ((uint32_t)record.payload[1] << 8) |
+                                ((uint32_t)record.payload[2] << 16) | ((uint32_t)record.payload[3] << 24));
+        break;
+
+    default:
+        return false;
+    }
+
+    if (success != wasGood)
+        stats.statusMismatches++;
+
+    return true;
+}
@@ -0,0 +1,83 @@
+// sfe_pca9846_replay.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwPCA9846TraceReplayer class runs a trace recorded by QwTraceBus again,
+// through a QwDevPCA9846 - typically on a host, over QwLinuxI2C (the real bus)
+// or QwSimBus (a model, for bus time). Control register writes and reads go
+// through the mux object; everything else goes straight to its bus. Each result
+// is compared with the recording: a transfer which now fails (or now succeeds),
+// or a read which returns different data, is counted as a mismatch.
+
+#pragma once
+
+#include "sfe_bus_trace.h"
+#include "sfe_pca9846.h"
+
+// Largest read which can be replayed
+#ifndef SFE_PCA9846_REPLAY_BUFFER
+#if defined(ARDUINO)
+#define SFE_PCA9846_REPLAY_BUFFER SFE_PCA9846_I2C_BUFFER_LENGTH
+#else
+#define SFE_PCA9846_REPLAY_BUFFER 256
+#endif
+#endif
+
+struct QwPCA9846ReplayStats
+{
+    uint32_t records;          // Records in the trace
+    uint32_t replayed;         // Records run again
+    uint32_t skipped;          // Truncated writes, and reads too big for the buffer
+    uint32_t statusMismatches; // Success / failure differs from the recording
+    uint32_t dataMismatches;   // Read data differs from the recording
+    uint32_t recordedMicros;   // Time covered by the trace
+};
+
+class QwPCA9846TraceReplayer
+{
+public:
+    QwPCA9846TraceReplayer(QwDevPCA9846 &mux);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // replay()
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  trace        An exported trace (QwTraceBus::exportTrace())
+    //  size         Size of the trace
+    //  stats        Results
+    //  retval       false if the trace is not valid or is corrupt, true otherwise
+
+    bool replay(const uint8_t *trace, uint32_t size, QwPCA9846ReplayStats &stats);
+
+private:
+    // Run one record. Returns false if it had to be skipped
+    bool replayRecord(const sfe_PCA9846::QwTraceRecord &record, QwPCA9846ReplayStats &stats);
+
+    // Compare data read now with the recorded payload
+    void compare(const uint8_t *data, uint16_t length, const uint8_t *recorded, uint16_t recordedLength,
+                 QwPCA9846ReplayStats &stats);
+
+    QwDevPCA9846 &_mux;
+};
@@ -0,0 +1,191 @@
+// sfe_pca9846_scheduler.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Port-affinity scheduling of downstream transfers. See sfe_pca9846_scheduler.h
+
+#include "sfe_pca9846_scheduler.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor
+//
+
+QwPCA9846Scheduler::QwPCA9846Scheduler(QwDevPCA9846 &mux) : _mux{mux}, _count{0}, _sequence{0}, _arrivalPort{0xFF}
+{
+    resetStats();
+}
+
+void QwPCA9846Scheduler::resetStats()
+{
+    _switches = 0;
+    _arrivalSwitches = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// submit()
+//
+
+bool QwPCA9846Scheduler::submit(const QwPCA9846Request &request)
+{
+    if ((_count >= SFE_PCA9846_SCHEDULER_QUEUE_SIZE) || (request.portNumber > 3))
+        return false;
+
+    Entry &entry = _queue[_count++];
+    entry.request = request;
+    entry.sequence = _sequence++;
+    entry.deferrals = 0;
+
+    if (entry.request.maxDeferrals == 0)
+        entry.request.maxDeferrals = SFE_PCA9846_SCHEDULER_DEFAULT_DEFERRALS;
+
+    // Executed in arrival order, every change of port would have cost a switch
+    if (request.portNumber != _arrivalPort)
+        _arrivalSwitches++;
+    _arrivalPort = request.portNumber;
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// selectedPort()
+//
+
+uint8_t QwPCA9846Scheduler::selectedPort()
+{
+    uint8_t portBits;
+    if (!_mux.getCachedPortState(portBits))
+        return 0xFF;
+
+    for (uint8_t port = 0; port < 4; port++)
+    {
+        if (portBits == (1 << port))
+            return port;
+    }
+
+    return 0xFF;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// pickNext()
+//
+// Overdue requests go first, oldest first. Otherwise: highest priority, then a request on the
+// port which is already selected, then the oldest.
+
+uint8_t QwPCA9846Scheduler::pickNext()
+{
+    uint8_t best = 0;
+    uint8_t currentPort = selectedPort();
+
+    for (uint8_t i = 1; i < _count; i++)
+    {
+        const Entry &a = _queue[i];
+        const Entry &b = _queue[best];
+
+        bool aOverdue = a.deferrals >= a.request.maxDeferrals;
+        bool bOverdue = b.deferrals >= b.request.maxDeferrals;
+
+        if (aOverdue != bOverdue)
+        {
+            if (aOverdue)
+                best = i;
+            continue;
+        }
+
+        if (!aOverdue)
+        {
+            if (a.request.priority != b.request.priority)
+            {
+                if (a.request.priority > b.request.priority)
+                    best = i;
+                continue;
+            }
+
+            bool aOnPort = a.request.portNumber == currentPort;
+            bool bOnPort = b.request.portNumber == currentPort;
+
+            if (aOnPort != bOnPort)
+            {
+                if (aOnPort)
+                    best = i;
+                continue;
+            }
+        }
+
+        if (a.sequence < b.sequence)
+            best = i;
+    }
+
+    return best;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// run()
+//
+
+uint8_t QwPCA9846Scheduler::run(uint8_t maxRequests)
+{
+    uint8_t executed = 0;
+
+    while ((_count > 0) && ((maxRequests == 0) || (executed < maxRequests)))
+    {
+        uint8_t next = pickNext();
+        QwPCA9846Request request = _queue[next].request;
+        uint32_t sequence = _queue[next].sequence;
+
+        // Remove it from the queue. Older requests which were passed over have been deferred once more
+        for (uint8_t i = next; i + 1 < _count; i++)
+            _queue[i] = _queue[i + 1];
+        _count--;
+
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            if ((_queue[i].sequence < sequence) && (_queue[i].deferrals < 0xFF))
+                _queue[i].deferrals++;
+        }
+
+        // setPort() costs nothing if the cache says the port is selected already
+        bool switching = request.portNumber != selectedPort();
+        bool success = _mux.setPort(request.portNumber);
+
+        if (success && switching)
+            _switches++;
+
+        if (success)
+        {
+            sfe_PCA9846::QwIDeviceBus *bus = _mux.getCommunicationBus();
+
+            if (request.isWrite)
+                success = bus->writeRegisterRegion(request.address, request.reg, request.data, request.length);
+            else
+                success = bus->readRegisterRegion(request.address, request.reg, request.data, request.length);
+        }
+
+        executed++;
+
+        if (request.callback)
+            request.callback(request, success);
+    }
+
+    return executed;
+}
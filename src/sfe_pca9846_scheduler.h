@@ -0,0 +1,132 @@
+// sfe_pca9846_scheduler.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwPCA9846Scheduler class queues downstream register reads and writes and
+// executes them grouped by mux port, so the mux switches channel as rarely as
+// possible. Reordering is bounded: requests are ordered by priority first, and a
+// request which has been passed over maxDeferrals times is executed next,
+// whatever its port. Only requests of equal priority are grouped by port.
+//
+// The scheduler counts how many port switches it made, and how many executing
+// the requests in arrival order would have cost.
+//
+// Every request selects its port with QwDevPCA9846::setPort(), so the mux may
+// also be used directly in between. Grouping relies on the mux cache
+// (QwDevPCA9846::enableCache()): it tells the scheduler which port is selected,
+// and lets setPort() skip the write when it already is. Without the cache,
+// every request writes the selection, and nothing is saved.
+
+#pragma once
+
+#include "sfe_pca9846.h"
+
+#ifndef SFE_PCA9846_SCHEDULER_QUEUE_SIZE
+#define SFE_PCA9846_SCHEDULER_QUEUE_SIZE 16
+#endif
+
+// Used when a request does not set maxDeferrals
+#define SFE_PCA9846_SCHEDULER_DEFAULT_DEFERRALS 8
+
+struct QwPCA9846Request;
+
+typedef void (*QwPCA9846RequestCallback)(const QwPCA9846Request &request, bool success);
+
+struct QwPCA9846Request
+{
+    uint8_t portNumber;   // Mux port the device is attached to (0-3)
+    uint8_t address;      // I2C address of the device
+    uint8_t reg;          // Register to read from / write to
+    bool isWrite;         // true = write, false = read
+    uint8_t *data;        // Data to write, or buffer to read into. Must stay valid until completion
+    uint8_t length;       // Number of bytes
+    uint8_t priority;     // Higher runs first
+    uint8_t maxDeferrals; // Times the request may be passed over. 0 = default
+    QwPCA9846RequestCallback callback; // Optional. Called on completion
+    void *context;        // Passed through untouched
+};
+
+class QwPCA9846Scheduler
+{
+public:
+    QwPCA9846Scheduler(QwDevPCA9846 &mux);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // submit()
+    //
+    // Queue a request. The request is copied; its data buffer is not.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  request      The request
+    //  retval       false = queue full or bad request, true = queued
+
+    bool submit(const QwPCA9846Request &request);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // run()
+    //
+    // Execute queued requests.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  maxRequests  Maximum number of requests to execute. 0 = until the queue is empty
+    //  retval       Number of requests executed
+
+    uint8_t run(uint8_t maxRequests = 0);
+
+    uint8_t pending() { return _count; }
+
+    // Port switches made (selection writes which succeeded), and the switches executing in arrival order would have made
+    uint32_t getSwitches() { return _switches; }
+    uint32_t getArrivalOrderSwitches() { return _arrivalSwitches; }
+    uint32_t getSwitchesSaved() { return _arrivalSwitches > _switches ? _arrivalSwitches - _switches : 0; }
+
+    void resetStats();
+
+private:
+    struct Entry
+    {
+        QwPCA9846Request request;
+        uint32_t sequence; // Arrival order
+        uint8_t deferrals;
+    };
+
+    // Index of the entry to execute next
+    uint8_t pickNext();
+
+    // The port the mux cache says is selected on its own. 0xFF if unknown
+    uint8_t selectedPort();
+
+    QwDevPCA9846 &_mux;
+
+    Entry _queue[SFE_PCA9846_SCHEDULER_QUEUE_SIZE];
+    uint8_t _count;
+    uint32_t _sequence;
+
+    uint8_t _arrivalPort; // Port of the last submitted request
+
+    uint32_t _switches;
+    uint32_t _arrivalSwitches;
+};
@@ -0,0 +1,248 @@
+// sfe_pca9846_shards.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Muxes on independent I2C controllers, run in parallel. See sfe_pca9846_shards.h
+
+#include "sfe_pca9846_shards.h"
+
+#if defined(SFE_PCA9846_HAS_SHARDS)
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor
+//
+
+QwPCA9846ShardedExecutor::QwPCA9846ShardedExecutor() : _numShards{0}, _running{false}
+{
+}
+
+QwPCA9846ShardedExecutor::~QwPCA9846ShardedExecutor()
+{
+    stop();
+}
+
+uint8_t QwPCA9846ShardedExecutor::addShard(QwDevPCA9846 &mux)
+{
+    if (_running || (_numShards >= SFE_PCA9846_SHARDS_MAX))
+        return SFE_PCA9846_SHARD_INVALID;
+
+    _shards[_numShards].mux = &mux;
+    return _numShards++;
+}
+
+#if defined(ARDUINO)
+uint8_t QwPCA9846ShardedExecutor::addShard(TwoWire &wirePort, uint8_t address)
+{
+    if (_running || (_numShards >= SFE_PCA9846_SHARDS_MAX))
+        return SFE_PCA9846_SHARD_INVALID;
+
+    Shard &shard = _shards[_numShards];
+
+    shard.ownedBus.init(wirePort);
+    shard.ownedMux.setCommunicationBus(shard.ownedBus, address);
+    if (!shard.ownedMux.init())
+        return SFE_PCA9846_SHARD_INVALID;
+    shard.ownedMux.enableCache(); // Only this shard uses the mux, so the port is only selected on a change
+
+    return addShard(shard.ownedMux);
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// start() / stop()
+//
+
+bool QwPCA9846ShardedExecutor::start()
+{
+    if (_running || (_numShards == 0))
+        return false;
+
+    for (uint8_t i = 0; i < _numShards; i++)
+    {
+        Shard &shard = _shards[i];
+
+        shard.head = 0;
+        shard.count = 0;
+        shard.busy = false;
+        shard.stopping = false;
+        shard.jobs = 0;
+        shard.failures = 0;
+        shard.busyMicros = 0;
+        shard.since = std::chrono::steady_clock::now();
+
+        shard.thread = std::thread(&QwPCA9846ShardedExecutor::work, this, std::ref(shard));
+    }
+
+    _running = true;
+    return true;
+}
+
+void QwPCA9846ShardedExecutor::stop()
+{
+    if (!_running)
+        return;
+
+    for (uint8_t i = 0; i < _numShards; i++)
+    {
+        Shard &shard = _shards[i];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.stopping = true;
+        }
+        shard.changed.notify_all();
+    }
+
+    for (uint8_t i = 0; i < _numShards; i++)
+        _shards[i].thread.join();
+
+    _running = false;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// submit()
+//
+
+bool QwPCA9846ShardedExecutor::submit(uint8_t shardPort, QwPCA9846ShardJob job, void *context)
+{
+    uint8_t shardNumber = shardPort >> 2;
+
+    if (!_running || (shardNumber >= _numShards) || !job)
+        return false;
+
+    Shard &shard = _shards[shardNumber];
+    {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        shard.changed.wait(lock, [&shard]() { return (shard.count < SFE_PCA9846_SHARD_QUEUE_SIZE) || shard.stopping; });
+
+        // The thread may already have emptied the queue and ended, so the job would never run
+        if (shard.stopping)
+            return false;
+
+        uint8_t tail = (shard.head + shard.count) % SFE_PCA9846_SHARD_QUEUE_SIZE;
+        shard.queue[tail].job = job;
+        shard.queue[tail].context = context;
+        shard.queue[tail].portNumber = shardPort & 0x03;
+        shard.count++;
+    }
+    shard.changed.notify_all();
+
+    return true;
+}
+
+void QwPCA9846ShardedExecutor::wait()
+{
+    if (!_running)
+        return;
+
+    for (uint8_t i = 0; i < _numShards; i++)
+    {
+        Shard &shard = _shards[i];
+
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        shard.changed.wait(lock, [&shard]() { return (shard.count == 0) && !shard.busy; });
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// work()
+//
+// The job runs without the lock held, so submit() and getStats() never wait for the bus. On
+// stop(), the queue is emptied before the thread ends.
+
+void QwPCA9846ShardedExecutor::work(Shard &shard)
+{
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    while (true)
+    {
+        shard.changed.wait(lock, [&shard]() { return (shard.count > 0) || shard.stopping; });
+        if (shard.count == 0)
+            break;
+
+        Job job = shard.queue[shard.head];
+        shard.head = (shard.head + 1) % SFE_PCA9846_SHARD_QUEUE_SIZE;
+        shard.count--;
+        shard.busy = true;
+
+        lock.unlock();
+        shard.changed.notify_all(); // Room in the queue
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        sfe_PCA9846::QwPortBus bus(*shard.mux, job.portNumber);
+        bool success = job.job(bus, job.context);
+        uint64_t busy = microsSince(start);
+
+        lock.lock();
+        shard.busy = false;
+        shard.jobs++;
+        if (!success)
+            shard.failures++;
+        shard.busyMicros += busy;
+
+        shard.changed.notify_all(); // For wait()
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// getStats()
+//
+
+bool QwPCA9846ShardedExecutor::getStats(uint8_t shardNumber, QwPCA9846ShardStats &stats)
+{
+    if (shardNumber >= _numShards)
+        return false;
+
+    Shard &shard = _shards[shardNumber];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    stats.jobs = shard.jobs;
+    stats.failures = shard.failures;
+    stats.busyMicros = shard.busyMicros;
+    stats.elapsedMicros = microsSince(shard.since);
+    stats.utilization = stats.elapsedMicros ? (uint8_t)((stats.busyMicros * 100) / stats.elapsedMicros) : 0;
+    stats.queued = shard.count;
+
+    return true;
+}
+
+void QwPCA9846ShardedExecutor::resetStats()
+{
+    for (uint8_t i = 0; i < _numShards; i++)
+    {
+        Shard &shard = _shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        shard.jobs = 0;
+        shard.failures = 0;
+        shard.busyMicros = 0;
+        shard.since = std::chrono::steady_clock::now();
+    }
+}
+
+uint64_t QwPCA9846ShardedExecutor::microsSince(std::chrono::steady_clock::time_point start)
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif
@@ -0,0 +1,196 @@
+// sfe_pca9846_shards.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwPCA9846ShardedExecutor class runs several muxes in parallel, each on
+// its own I2C controller. Each mux and its bus is a shard, with a worker thread
+// of its own and a queue of jobs. A job is addressed to a port of a shard
+// (SFE_PCA9846_SHARD_PORT()), and runs on that shard's thread with a bus scoped
+// to the port (a QwPortBus), so a downstream driver can be called from it as
+// it is. Jobs on one shard run one after the other, in the order submitted;
+// jobs on different shards overlap, so the throughput grows with the number of
+// controllers as long as the work is spread over them.
+//
+// Each shard reports its utilization: the share of the time its thread spent
+// running jobs. A shard near 100% is the bottleneck; move devices off it.
+//
+// Once the executor is started, its muxes must only be used through it.
+// Needs std::thread, std::mutex and std::condition_variable (desktop, ESP32, ...).
+
+#pragma once
+
+#include "sfe_pca9846.h"
+#include "sfe_port_bus.h"
+
+#if defined(__has_include)
+#if __has_include(<thread>) && __has_include(<mutex>) && __has_include(<condition_variable>) && __has_include(<chrono>) && \
+    __has_include(<atomic>)
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#if !defined(__GLIBCXX__) || defined(_GLIBCXX_HAS_GTHREADS)
+#define SFE_PCA9846_HAS_SHARDS 1
+#endif
+#endif
+#endif
+
+#if defined(SFE_PCA9846_HAS_SHARDS)
+
+// Maximum number of shards - one per I2C controller
+#ifndef SFE_PCA9846_SHARDS_MAX
+#define SFE_PCA9846_SHARDS_MAX 4
+#endif
+
+// Jobs each shard can hold before submit() waits
+#ifndef SFE_PCA9846_SHARD_QUEUE_SIZE
+#define SFE_PCA9846_SHARD_QUEUE_SIZE 16
+#endif
+
+// Returned by addShard() when there is no room
+#define SFE_PCA9846_SHARD_INVALID 0xFF
+
+// Address of a port on a shard, for submit()
+#define SFE_PCA9846_SHARD_PORT(shard, port) ((uint8_t)(((shard) << 2) | ((port) & 0x03)))
+
+// A job. bus is scoped to the port the job was submitted to. Return false on failure
+typedef bool (*QwPCA9846ShardJob)(sfe_PCA9846::QwIDeviceBus &bus, void *context);
+
+struct QwPCA9846ShardStats
+{
+    uint32_t jobs;          // Jobs run
+    uint32_t failures;      // Jobs which returned false
+    uint64_t busyMicros;    // Time spent running jobs
+    uint64_t elapsedMicros; // Time since start() or resetStats()
+    uint8_t utilization;    // busyMicros as a percentage of elapsedMicros
+    uint8_t queued;         // Jobs waiting to run
+};
+
+class QwPCA9846ShardedExecutor
+{
+public:
+    QwPCA9846ShardedExecutor();
+
+    // Stops the executor, after the queued jobs have run
+    ~QwPCA9846ShardedExecutor();
+
+    QwPCA9846ShardedExecutor(const QwPCA9846ShardedExecutor &) = delete;
+    QwPCA9846ShardedExecutor &operator=(const QwPCA9846ShardedExecutor &) = delete;
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // addShard()
+    //
+    // Add a mux which is already set up on a bus of its own (e.g. a SparkFun_PCA9846
+    // after begin()). Shards are numbered in the order they are added. Call before start().
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  mux          The mux
+    //  retval       Shard number, or SFE_PCA9846_SHARD_INVALID if there is no room
+
+    uint8_t addShard(QwDevPCA9846 &mux);
+
+#if defined(ARDUINO)
+    // Add a shard with its own mux and QwI2C on wirePort. The mux is initialised; returns
+    // SFE_PCA9846_SHARD_INVALID if it does not answer
+    uint8_t addShard(TwoWire &wirePort, uint8_t address = SFE_PCA9846_MUX_DEFAULT_ADDRESS);
+#endif
+
+    // Start one thread per shard. Returns false if already running, or there are no shards
+    bool start();
+
+    // Run the jobs already queued, then stop the threads
+    void stop();
+
+    bool isRunning() { return _running; }
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // submit()
+    //
+    // Queue a job on a port of a shard. If the shard's queue is full, wait for room, or for stop().
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  shardPort    SFE_PCA9846_SHARD_PORT(shard, port)
+    //  job          The job
+    //  context      Passed to the job
+    //  retval       false if the executor is not running, is stopping, or the shard does not exist
+
+    bool submit(uint8_t shardPort, QwPCA9846ShardJob job, void *context = nullptr);
+
+    // Wait until every job submitted so far has run
+    void wait();
+
+    uint8_t getShards() { return _numShards; }
+
+    QwDevPCA9846 *getMux(uint8_t shard) { return (shard < _numShards) ? _shards[shard].mux : nullptr; }
+
+    bool getStats(uint8_t shard, QwPCA9846ShardStats &stats);
+    void resetStats();
+
+private:
+    struct Job
+    {
+        QwPCA9846ShardJob job;
+        void *context;
+        uint8_t portNumber;
+    };
+
+    struct Shard
+    {
+        QwDevPCA9846 *mux = nullptr;
+
+        QwDevPCA9846 ownedMux; // Used by addShard(TwoWire &, ...)
+#if defined(ARDUINO)
+        sfe_PCA9846::QwI2C ownedBus;
+#endif
+
+        std::thread thread;
+        std::mutex mutex; // Guards everything below
+        std::condition_variable changed;
+
+        Job queue[SFE_PCA9846_SHARD_QUEUE_SIZE];
+        uint8_t head = 0;
+        uint8_t count = 0;
+        bool busy = false;
+        bool stopping = false;
+
+        uint32_t jobs = 0;
+        uint32_t failures = 0;
+        uint64_t busyMicros = 0;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    // Thread body of a shard
+    void work(Shard &shard);
+
+    static uint64_t microsSince(std::chrono::steady_clock::time_point start);
+
+    Shard _shards[SFE_PCA9846_SHARDS_MAX];
+    uint8_t _numShards;
+    std::atomic<bool> _running; // Read by submit() and wait() from any thread
+};
+
+#endif
@@ -0,0 +1,199 @@
+// sfe_pca9846_static.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// QwDevPCA9846Static is QwDevPCA9846 with the bus type fixed at compile time.
+// The bus is called through its concrete type, so there is no virtual dispatch
+// and the compiler can inline the bus methods. BusType needs the same methods
+// as QwIDeviceBus but does not need to derive from it.
+
+#pragma once
+
+#include "sfe_pca9846.h"
+
+template <typename BusType>
+class QwDevPCA9846Static
+{
+public:
+    QwDevPCA9846Static() : _sfeBus{nullptr}, _i2cAddress{SFE_PCA9846_MUX_DEFAULT_ADDRESS} {};
+
+    // Control register value which enables only portNumber. Out of range disables all ports
+    static constexpr uint8_t portMask(uint8_t portNumber)
+    {
+        return portNumber > 3 ? 0 : (uint8_t)(1 << portNumber);
+    }
+
+    // Offset used to read the Device ID of the mux at address
+    static constexpr uint8_t deviceIdOffset(uint8_t address)
+    {
+        return (uint8_t)(address << 1);
+    }
+
+    void setCommunicationBus(BusType &theBus, uint8_t i2cAddress)
+    {
+        _sfeBus = &theBus;
+        _i2cAddress = i2cAddress;
+    }
+
+    void setCommunicationBus(BusType &theBus)
+    {
+        _sfeBus = &theBus;
+    }
+
+    BusType *getCommunicationBus() { return _sfeBus; }
+    uint8_t getAddress() { return _i2cAddress; }
+
+    // The explicit BusType:: qualification makes every bus call a direct call,
+    // even when BusType's methods are virtual
+
+    bool init()
+    {
+        if (!_sfeBus->BusType::ping(_i2cAddress))
+            return false;
+
+        return getUniqueId() == SFE_PCA9846_MUX_DEVICE_ID;
+    }
+
+    bool isConnected()
+    {
+        return getUniqueId() == SFE_PCA9846_MUX_DEVICE_ID;
+    }
+
+    uint32_t getUniqueId()
+    {
+        uint8_t chipID[3] = {0};
+        if (!_sfeBus->BusType::readRegisterRegion(SFE_PCA9846_MUX_DEVICE_ID_ADDRESS, deviceIdOffset(_i2cAddress), chipID, 3))
+            return 0;
+
+        return (((uint32_t)chipID[0]) << 16) | (((uint32_t)chipID[1]) << 8) | chipID[2];
+    }
+
+    bool write(uint8_t data)
+    {
+        return _sfeBus->BusType::write(_i2cAddress, data);
+    }
+
+    bool writeRegisterRegion(uint8_t reg, uint8_t *data, uint16_t length) // Split into writes which fit the bus buffer
+    {
+        // The register offset takes one byte of each write
+        uint16_t maxChunk = _sfeBus->BusType::maxTransferLength();
+        maxChunk = (maxChunk > 1) ? maxChunk - 1 : 1;
+
+        do
+        {
+            uint16_t chunk = (length > maxChunk) ? maxChunk : length;
+
+            if (!_sfeBus->BusType::writeRegisterRegion(_i2cAddress, reg, data, chunk))
+                return false;
+
+            data += chunk;
+            length -= chunk;
+            reg += chunk;
+        } while (length > 0);
+
+        return true;
+    }
+
+    bool read(uint8_t *data)
+    {
+        return _sfeBus->BusType::read(_i2cAddress, data);
+    }
+
+    bool readRegisterRegion(uint8_t reg, uint8_t *data, uint16_t length) // Split into reads which fit the bus buffer
+    {
+        uint16_t maxChunk = _sfeBus->BusType::maxTransferLength();
+        if (maxChunk > 0xFF)
+            maxChunk = 0xFF; // The bus takes a uint8_t length
+        if (maxChunk == 0)
+            maxChunk = 1;
+
+        while (length > 0)
+        {
+            uint8_t chunk = (length > maxChunk) ? (uint8_t)maxChunk : (uint8_t)length;
+
+            if (!_sfeBus->BusType::readRegisterRegion(_i2cAddress, reg, data, chunk))
+                return false;
+
+            data += chunk;
+            length -= chunk;
+            reg += chunk;
+        }
+
+        return true;
+    }
+
+    bool setPort(uint8_t portNumber) // Enable a single port. All other ports disabled.
+    {
+        return _sfeBus->BusType::write(_i2cAddress, portMask(portNumber));
+    }
+
+    bool setPortState(uint8_t portBits) // Overwrite port register with all 4 bits
+    {
+        return _sfeBus->BusType::write(_i2cAddress, portBits);
+    }
+
+    uint8_t getPort() // Returns the first enabled port. 255 if none, 254 on I2C error
+    {
+        uint8_t portBits = getPortState();
+        if (portBits == 254)
+            return 254;
+
+        for (uint8_t x = 0; x < 4; x++)
+        {
+            if (portBits & portMask(x))
+                return x;
+        }
+        return 255;
+    }
+
+    uint8_t getPortState() // Returns current 4-bit wide state. 254 on I2C error
+    {
+        uint8_t portBits;
+        if (!_sfeBus->BusType::read(_i2cAddress, &portBits))
+            return 254;
+        return portBits;
+    }
+
+    bool enablePort(uint8_t portNumber) // Enable a single port without affecting other bits
+    {
+        uint8_t settings = getPortState();
+        if (settings == 254)
+            return false;
+
+        return setPortState(settings | portMask(portNumber > 3 ? 3 : portNumber));
+    }
+
+    bool disablePort(uint8_t portNumber) // Disable a single port without affecting other bits
+    {
+        uint8_t settings = getPortState();
+        if (settings == 254)
+            return false;
+
+        return setPortState(settings & ~portMask(portNumber > 3 ? 3 : portNumber));
+    }
+
+private:
+    BusType *_sfeBus;
+    uint8_t _i2cAddress;
+};
@@ -0,0 +1,219 @@
+// sfe_pca9846_transaction.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Deferred, coalesced mux transactions. See sfe_pca9846_transaction.h
+
+#include "sfe_pca9846_transaction.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor
+//
+
+QwPCA9846Transaction::QwPCA9846Transaction(QwDevPCA9846 &mux) : _mux{mux}, _numOps{0}, _requested{0}, _executed{0}
+{
+}
+
+bool QwPCA9846Transaction::add(uint8_t type, uint8_t value, uint8_t reg, uint8_t *data, uint16_t length)
+{
+    if (_numOps >= SFE_PCA9846_TRANSACTION_MAX_OPS)
+        return false;
+
+    Op &op = _ops[_numOps++];
+    op.type = type;
+    op.value = value;
+    op.reg = reg;
+    op.data = data;
+    op.length = length;
+
+    return true;
+}
+
+bool QwPCA9846Transaction::setPort(uint8_t portNumber)
+{
+    // As QwDevPCA9846::setPort(): 4 or more disables all ports
+    return add(kOpSetState, portNumber > 3 ? 0 : 1 << portNumber);
+}
+
+bool QwPCA9846Transaction::setPortState(uint8_t portBits)
+{
+    return add(kOpSetState, portBits);
+}
+
+bool QwPCA9846Transaction::enablePort(uint8_t portNumber)
+{
+    return add(kOpEnable, portNumber > 3 ? 3 : portNumber);
+}
+
+bool QwPCA9846Transaction::disablePort(uint8_t portNumber)
+{
+    return add(kOpDisable, portNumber > 3 ? 3 : portNumber);
+}
+
+bool QwPCA9846Transaction::readRegisterRegion(uint8_t address, uint8_t reg, uint8_t *data, uint8_t length)
+{
+    return add(kOpRead, address, reg, data, length);
+}
+
+bool QwPCA9846Transaction::writeRegisterRegion(uint8_t address, uint8_t reg, const uint8_t *data, uint16_t length)
+{
+    return add(kOpWrite, address, reg, (uint8_t *)data, length);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// flush()
+//
+// Bits to set / clear need the current value: from the cache if it is valid, otherwise read
+
+bool QwPCA9846Transaction::flush()
+{
+    if (!_pendingChange)
+        return true;
+
+    _pendingChange = false;
+
+    if (!_absolute && !_known)
+    {
+        if (_mux.getCachedPortState(_current))
+        {
+            _known = true;
+        }
+        else
+        {
+            _executed++;
+            _current = _mux.getPortState();
+            if (_current == 254)
+                return false;
+            _known = true;
+        }
+    }
+
+    uint8_t target = _absolute ? _value : (uint8_t)((_current & ~_clearBits) | _setBits);
+
+    if (_known && (target == _current))
+        return true; // No change: nothing to write
+
+    _executed++;
+    if (!_mux.setPortState(target))
+    {
+        _known = false;
+        return false;
+    }
+
+    _current = target;
+    _known = true;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// commit()
+//
+
+bool QwPCA9846Transaction::commit()
+{
+    sfe_PCA9846::QwIDeviceBus *bus = _mux.getCommunicationBus();
+
+    _requested = 0;
+    _executed = 0;
+    _pendingChange = false;
+    _known = _mux.getCachedPortState(_current);
+
+    // Whether the same operations, done directly, would find the cache valid. Each direct
+    // change refills it, if it is enabled
+    bool directKnown = _known;
+
+    bool success = bus != nullptr;
+
+    for (uint8_t i = 0; success && (i < _numOps); i++)
+    {
+        const Op &op = _ops[i];
+
+        switch (op.type)
+        {
+        case kOpSetState:
+            _requested += 1;
+            directKnown = _mux.isCacheEnabled();
+            _pendingChange = true;
+            _absolute = true;
+            _value = op.value;
+            break;
+
+        case kOpEnable:
+        case kOpDisable:
+        {
+            // Done directly, these cost a read and a write - or just the write, with a valid cache
+            _requested += directKnown ? 1 : 2;
+            directKnown = _mux.isCacheEnabled();
+
+            uint8_t bit = 1 << op.value;
+
+            if (!_pendingChange)
+            {
+                _pendingChange = true;
+                _absolute = false;
+                _setBits = 0;
+                _clearBits = 0;
+            }
+
+            if (_absolute)
+            {
+                _value = (op.type == kOpEnable) ? (_value | bit) : (_value & ~bit);
+            }
+            else if (op.type == kOpEnable)
+            {
+                _setBits |= bit;
+                _clearBits &= ~bit;
+            }
+            else
+            {
+                _clearBits |= bit;
+                _setBits &= ~bit;
+            }
+        }
+        break;
+
+        case kOpRead:
+        case kOpWrite:
+            _requested += 1;
+            success = flush();
+
+            if (success)
+            {
+                _executed++;
+
+                if (op.type == kOpRead)
+                    success = bus->readRegisterRegionChunked(op.value, op.reg, op.data, op.length);
+                else
+                    success = bus->writeRegisterRegionChunked(op.value, op.reg, op.data, op.length);
+            }
+            break;
+        }
+    }
+
+    if (success)
+        success = flush();
+
+    _numOps = 0;
+    return success;
+}
@@ -0,0 +1,143 @@
+// sfe_pca9846_transaction.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwPCA9846Transaction class records port changes and downstream register
+// reads / writes, and runs them on commit(). Runs of port changes are folded
+// into one control register write, made just before the next downstream
+// operation (or at the end), and only if the register actually changes. So:
+//
+//     transaction.enablePort(1);
+//     transaction.enablePort(2);
+//     transaction.disablePort(0);
+//     transaction.commit();
+//
+// costs one control register write - plus one read, if the current value is
+// needed and the mux cache (QwDevPCA9846::enableCache()) does not have it.
+//
+// commit() counts the bus transactions the operations would have cost one by
+// one (requested), and the transactions actually made (executed).
+
+#pragma once
+
+#include "sfe_pca9846.h"
+
+// Maximum number of operations in one transaction
+#ifndef SFE_PCA9846_TRANSACTION_MAX_OPS
+#define SFE_PCA9846_TRANSACTION_MAX_OPS 16
+#endif
+
+class QwPCA9846Transaction
+{
+public:
+    QwPCA9846Transaction(QwDevPCA9846 &mux);
+
+    // Port changes, as the QwDevPCA9846 methods of the same name. Return false if the transaction is full
+    bool setPort(uint8_t portNumber);
+    bool setPortState(uint8_t portBits);
+    bool enablePort(uint8_t portNumber);
+    bool disablePort(uint8_t portNumber);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // readRegisterRegion() / writeRegisterRegion()
+    //
+    // Record a register transfer to a downstream device, made with whatever ports
+    // the port changes before it have enabled. Nothing is copied: the buffer must
+    // stay valid until commit() returns.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  address      I2C address of the device
+    //  reg          Register offset
+    //  data         Buffer to read into / data to write
+    //  length       Number of bytes
+    //  retval       false if the transaction is full
+
+    bool readRegisterRegion(uint8_t address, uint8_t reg, uint8_t *data, uint8_t length);
+    bool writeRegisterRegion(uint8_t address, uint8_t reg, const uint8_t *data, uint16_t length);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // commit()
+    //
+    // Run the transaction. Stops at the first failure. The transaction is empty
+    // afterwards, whatever the result.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  retval       false = error, true = success
+
+    bool commit();
+
+    // Drop the recorded operations
+    void clear() { _numOps = 0; }
+
+    uint8_t pending() { return _numOps; }
+
+    // Bus transactions of the last commit(): as recorded, and as executed
+    uint16_t getRequested() { return _requested; }
+    uint16_t getExecuted() { return _executed; }
+
+private:
+    enum OpType
+    {
+        kOpSetState,
+        kOpEnable,
+        kOpDisable,
+        kOpRead,
+        kOpWrite
+    };
+
+    struct Op
+    {
+        uint8_t type;    // OpType
+        uint8_t value;   // Port bits (kOpSetState), port number, or I2C address
+        uint8_t reg;
+        uint16_t length;
+        uint8_t *data;
+    };
+
+    bool add(uint8_t type, uint8_t value, uint8_t reg = 0, uint8_t *data = nullptr, uint16_t length = 0);
+
+    // Write the folded port changes, if they change the control register
+    bool flush();
+
+    QwDevPCA9846 &_mux;
+
+    Op _ops[SFE_PCA9846_TRANSACTION_MAX_OPS];
+    uint8_t _numOps;
+
+    // Folded port changes, during commit(): either an absolute value, or bits to set / clear
+    bool _pendingChange;
+    bool _absolute;
+    uint8_t _value;
+    uint8_t _setBits;
+    uint8_t _clearBits;
+
+    // Control register value, as far as commit() knows
+    bool _known;
+    uint8_t _current;
+
+    uint16_t _requested;
+    uint16_t _executed;
+};
@@ -0,0 +1,242 @@
+// sfe_pca9846_tree.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Routing through a tree of PCA9846 muxes. See sfe_pca9846_tree.h
+
+#include "sfe_pca9846_tree.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor
+//
+
+QwPCA9846Tree::QwPCA9846Tree() : _numMuxes{0}, _numDevices{0}, _activeDepth{0}, _activeValid{false}, _switchWrites{0}
+{
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// addMux()
+//
+
+uint8_t QwPCA9846Tree::addMux(QwDevPCA9846 &mux, uint8_t parentIndex, uint8_t parentPort)
+{
+    if (_numMuxes >= SFE_PCA9846_TREE_MAX_MUXES)
+        return SFE_PCA9846_TREE_INVALID;
+
+    if (parentIndex != SFE_PCA9846_TREE_ROOT)
+    {
+        if ((parentIndex >= _numMuxes) || (parentPort > 3))
+            return SFE_PCA9846_TREE_INVALID;
+    }
+
+    Node &node = _nodes[_numMuxes];
+    node.mux = &mux;
+    node.parent = parentIndex;
+    node.parentPort = parentPort;
+    node.depth = (parentIndex == SFE_PCA9846_TREE_ROOT) ? 0 : _nodes[parentIndex].depth + 1;
+
+    // The new mux is in an unknown state until the next reset()
+    _activeValid = false;
+
+    return _numMuxes++;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// addDevice()
+//
+
+uint8_t QwPCA9846Tree::addDevice(uint8_t muxIndex, uint8_t portNumber, uint8_t address)
+{
+    if ((_numDevices >= SFE_PCA9846_TREE_MAX_DEVICES) || (muxIndex >= _numMuxes) || (portNumber > 3))
+        return SFE_PCA9846_TREE_INVALID;
+
+    Device &device = _devices[_numDevices];
+    device.muxIndex = muxIndex;
+    device.portNumber = portNumber;
+    device.address = address;
+
+    return _numDevices++;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// writeControl()
+//
+// Only writes which reach the bus are counted: the mux skips a write its cache already holds,
+// and refuses one to an isolated port.
+
+bool QwPCA9846Tree::writeControl(uint8_t muxIndex, uint8_t portBits, bool force)
+{
+    QwDevPCA9846 *mux = _nodes[muxIndex].mux;
+
+    if (force)
+        mux->invalidateCache();
+
+    uint8_t cached;
+    bool skipped = mux->getCachedPortState(cached) && (cached == portBits);
+    bool refused = (portBits & mux->getIsolatedPorts()) != 0;
+
+    if (!skipped && !refused)
+        _switchWrites++;
+
+    return mux->setPortState(portBits);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// reset()
+//
+// Muxes are disabled one depth level at a time. When a level is reached, every mux above it
+// has been disabled, so routing to a parent exposes only that parent's direct children. Two
+// muxes answering the same address at that point both receive the 0 - which is harmless.
+// After a bus error the shadow copies can not be trusted, so every 0 is written for real.
+
+bool QwPCA9846Tree::reset()
+{
+    _activeDepth = 0;
+    _activeValid = true;
+
+    uint8_t maxDepth = 0;
+    for (uint8_t i = 0; i < _numMuxes; i++)
+    {
+        if (_nodes[i].depth > maxDepth)
+            maxDepth = _nodes[i].depth;
+    }
+
+    for (uint8_t depth = 0; depth <= maxDepth; depth++)
+    {
+        for (uint8_t i = 0; i < _numMuxes; i++)
+        {
+            if (_nodes[i].depth != depth)
+                continue;
+
+            if ((depth > 0) && !select(_nodes[i].parent, _nodes[i].parentPort))
+            {
+                _activeValid = false;
+                return false;
+            }
+
+            if (!writeControl(i, 0, true))
+            {
+                _activeValid = false;
+                return false;
+            }
+        }
+    }
+
+    return selectUpstream();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// route()
+//
+// The part of the active path shared with the new path is left alone. Below that, the old
+// path is dismantled deepest mux first - each write still reaches its mux because the muxes
+// above it are unchanged - and then the new path is built top down.
+
+bool QwPCA9846Tree::route(const uint8_t *muxes, const uint8_t *ports, uint8_t depth)
+{
+    if (!_activeValid)
+    {
+        if (!reset())
+            return false;
+    }
+
+    // Length of the common prefix
+    uint8_t common = 0;
+    while ((common < depth) && (common < _activeDepth) && (_activeMux[common] == muxes[common]) && (_activePort[common] == ports[common]))
+        common++;
+
+    // If the paths diverge at the same mux, it only needs its port changing
+    bool sameMux = (common < depth) && (common < _activeDepth) && (_activeMux[common] == muxes[common]);
+
+    // Disable the old branch, deepest first
+    uint8_t stop = sameMux ? common + 1 : common;
+    while (_activeDepth > stop)
+    {
+        _activeDepth--;
+        if (!writeControl(_activeMux[_activeDepth], 0))
+        {
+            _activeValid = false;
+            return false;
+        }
+    }
+
+    // Enable the new branch, top down
+    for (uint8_t i = common; i < depth; i++)
+    {
+        if (!writeControl(muxes[i], 1 << ports[i]))
+        {
+            _activeValid = false;
+            return false;
+        }
+
+        _activeMux[i] = muxes[i];
+        _activePort[i] = ports[i];
+    }
+
+    _activeDepth = depth;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// select()
+//
+
+bool QwPCA9846Tree::select(uint8_t muxIndex, uint8_t portNumber)
+{
+    if ((muxIndex >= _numMuxes) || (portNumber > 3))
+        return false;
+
+    // Build the path from the upstream bus down to the mux
+    uint8_t muxes[SFE_PCA9846_TREE_MAX_MUXES];
+    uint8_t ports[SFE_PCA9846_TREE_MAX_MUXES];
+    uint8_t depth = _nodes[muxIndex].depth + 1;
+
+    uint8_t index = muxIndex;
+    uint8_t port = portNumber;
+    for (uint8_t i = depth; i > 0; i--)
+    {
+        muxes[i - 1] = index;
+        ports[i - 1] = port;
+        port = _nodes[index].parentPort;
+        index = _nodes[index].parent;
+    }
+
+    return route(muxes, ports, depth);
+}
+
+bool QwPCA9846Tree::selectDevice(uint8_t handle, uint8_t *address)
+{
+    if (handle >= _numDevices)
+        return false;
+
+    if (address)
+        *address = _devices[handle].address;
+
+    return select(_devices[handle].muxIndex, _devices[handle].portNumber);
+}
+
+bool QwPCA9846Tree::selectUpstream()
+{
+    return route(nullptr, nullptr, 0);
+}
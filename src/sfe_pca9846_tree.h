@@ -0,0 +1,154 @@
+// sfe_pca9846_tree.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwPCA9846Tree class routes the upstream bus through a tree of PCA9846
+// muxes. Muxes can sit directly on the upstream bus or behind a port of another
+// mux. select() connects the upstream bus to one port of one mux and only writes
+// to the muxes whose state has to change: the part of the currently active path
+// which is shared with the new one is left alone. Every mux which is not on the
+// active path is kept with all of its ports disabled, so branches never expose
+// two devices (or two muxes) with the same address at once.
+
+#pragma once
+
+#include "sfe_pca9846.h"
+
+#ifndef SFE_PCA9846_TREE_MAX_MUXES
+#define SFE_PCA9846_TREE_MAX_MUXES 8
+#endif
+
+#ifndef SFE_PCA9846_TREE_MAX_DEVICES
+#define SFE_PCA9846_TREE_MAX_DEVICES 32
+#endif
+
+#define SFE_PCA9846_TREE_ROOT 0xFF    // Parent index of a mux on the upstream bus
+#define SFE_PCA9846_TREE_INVALID 0xFF // Returned by addMux() / addDevice() on error
+
+class QwPCA9846Tree
+{
+public:
+    QwPCA9846Tree();
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // addMux()
+    //
+    // Register a mux. Parents must be registered before their children.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  mux          The mux. Its communication bus must already be set
+    //  parentIndex  Index of the parent mux, or SFE_PCA9846_TREE_ROOT
+    //  parentPort   Port of the parent mux the mux is attached to
+    //  retval       Index of the mux, or SFE_PCA9846_TREE_INVALID on error
+
+    uint8_t addMux(QwDevPCA9846 &mux, uint8_t parentIndex = SFE_PCA9846_TREE_ROOT, uint8_t parentPort = 0);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // addDevice()
+    //
+    // Register a downstream device, so it can be selected by handle.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  muxIndex     Index of the mux the device is attached to
+    //  portNumber   Port of that mux
+    //  address      I2C address of the device
+    //  retval       Device handle, or SFE_PCA9846_TREE_INVALID on error
+
+    uint8_t addDevice(uint8_t muxIndex, uint8_t portNumber, uint8_t address);
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // reset()
+    //
+    // Disable every port of every mux, parents first. Call once after the muxes
+    // have been registered, and again after a bus error. On return only the
+    // upstream bus is connected.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  retval       false = error, true = success
+
+    bool reset();
+
+    //////////////////////////////////////////////////////////////////////////////////
+    // select()
+    //
+    // Connect the upstream bus to one port of one mux.
+    //
+    //  Parameter    Description
+    //  ---------    -----------------------------
+    //  muxIndex     Index of the mux
+    //  portNumber   Port to connect (0-3)
+    //  retval       false = error, true = success
+
+    bool select(uint8_t muxIndex, uint8_t portNumber);
+
+    // Connect the upstream bus to a registered device. Returns its address via *address
+    bool selectDevice(uint8_t handle, uint8_t *address = nullptr);
+
+    // Disconnect every port, leaving only the upstream bus
+    bool selectUpstream();
+
+    uint8_t getNumMuxes() { return _numMuxes; }
+
+    // Number of control register writes issued since construction
+    uint32_t getSwitchWrites() { return _switchWrites; }
+
+private:
+    struct Node
+    {
+        QwDevPCA9846 *mux;
+        uint8_t parent;
+        uint8_t parentPort;
+        uint8_t depth;
+    };
+
+    struct Device
+    {
+        uint8_t muxIndex;
+        uint8_t portNumber;
+        uint8_t address;
+    };
+
+    // Write a mux's control register. force: forget the mux's cached value first, so the write is never skipped
+    bool writeControl(uint8_t muxIndex, uint8_t portBits, bool force = false);
+
+    // Make the active path match the first 'depth' entries of (muxes, ports)
+    bool route(const uint8_t *muxes, const uint8_t *ports, uint8_t depth);
+
+    Node _nodes[SFE_PCA9846_TREE_MAX_MUXES];
+    uint8_t _numMuxes;
+
+    Device _devices[SFE_PCA9846_TREE_MAX_DEVICES];
+    uint8_t _numDevices;
+
+    // Active path, from the upstream bus down
+    uint8_t _activeMux[SFE_PCA9846_TREE_MAX_MUXES];
+    uint8_t _activePort[SFE_PCA9846_TREE_MAX_MUXES];
+    uint8_t _activeDepth;
+    bool _activeValid;
+
+    uint32_t _switchWrites;
+};
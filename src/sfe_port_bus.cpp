@@ -0,0 +1,157 @@
+// sfe_port_bus.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Bus adapter for one downstream port of the mux. See sfe_port_bus.h
+
+#include "sfe_port_bus.h"
+
+namespace sfe_PCA9846
+{
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructor
+    //
+
+    QwPortBus::QwPortBus(QwDevPCA9846 &mux, uint8_t portNumber) : _mux{mux}, _portNumber{portNumber}
+    {
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // select()
+    //
+    // With the cache enabled, setPort() only writes to the mux when the selection changes. A port
+    // number out of range is refused: setPort() would disable every port, leaving the transfer to
+    // go out on the upstream bus.
+
+    bool QwPortBus::select()
+    {
+        if ((_portNumber > 3) || !_mux.getCommunicationBus())
+            return false;
+
+        if (!_mux.setPort(_portNumber))
+        {
+            _mux.invalidateCache();
+            return false;
+        }
+
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // finish()
+    //
+    // A transfer can fail because the mux lost its selection (a reset, a glitch). Don't trust the
+    // cache after a failure: the next transfer writes the selection again.
+
+    bool QwPortBus::finish(bool success)
+    {
+        if (!success)
+            _mux.invalidateCache();
+
+        return success;
+    }
+
+    bool QwPortBus::ping(uint8_t address)
+    {
+        if (!select())
+            return false;
+
+        return finish(_mux.getCommunicationBus()->ping(address));
+    }
+
+    bool QwPortBus::write(uint8_t address, uint8_t data)
+    {
+        if (!select())
+            return false;
+
+        return finish(_mux.getCommunicationBus()->write(address, data));
+    }
+
+    bool QwPortBus::writeRegisterByte(uint8_t address, uint8_t offset, uint8_t data)
+    {
+        if (!select())
+            return false;
+
+        return finish(_mux.getCommunicationBus()->writeRegisterByte(address, offset, data));
+    }
+
+    bool QwPortBus::writeRegisterRegion(uint8_t address, uint8_t offset, const uint8_t *data, uint16_t length)
+    {
+        if (!select())
+            return false;
+
+        return finish(_mux.getCommunicationBus()->writeRegisterRegion(address, offset, data, length));
+    }
+
+    bool QwPortBus::read(uint8_t address, uint8_t *data)
+    {
+        if (!select())
+            return false;
+
+        return finish(_mux.getCommunicationBus()->read(address, data));
+    }
+
+    bool QwPortBus::readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length)
+    {
+        if (!select())
+            return false;
+
+        return finish(_mux.getCommunicationBus()->readRegisterRegion(address, offset, data, length));
+    }
+
+    bool QwPortBus::transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength)
+    {
+        if (!_mux.getCommunicationBus())
+            return false;
+
+        return finish(_mux.transferOnPort(_portNumber, address, tx, txLength, rx, rxLength));
+    }
+
+    bool QwPortBus::transferSegments(uint8_t address, const QwWriteSegment *tx, uint8_t txCount, const QwReadSegment *rx,
+                                     uint8_t rxCount)
+    {
+        if (!_mux.getCommunicationBus())
+            return false;
+
+        return finish(_mux.transferSegmentsOnPort(_portNumber, address, tx, txCount, rx, rxCount));
+    }
+
+    uint8_t QwPortBus::getLastError()
+    {
+        if (!_mux.getCommunicationBus())
+            return SFE_PCA9846_BUS_ERROR_NO_BUS;
+
+        return _mux.getCommunicationBus()->getLastError();
+    }
+
+    uint16_t QwPortBus::maxTransferLength()
+    {
+        if (!_mux.getCommunicationBus())
+            return SFE_PCA9846_I2C_BUFFER_LENGTH;
+
+        return _mux.getCommunicationBus()->maxTransferLength();
+    }
+
+}
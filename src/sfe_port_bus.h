@@ -0,0 +1,100 @@
+// sfe_port_bus.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwPortBus class represents one downstream port of a PCA9846 mux as a bus
+// of its own. Drivers written against QwIDeviceBus can use it unmodified: the
+// port is selected on demand, before each transfer, and only when the mux is
+// not already connected to it.
+//
+// The adapter leaves the cache policy of the mux alone. Turn on the shadow copy
+// of the mux control register (QwDevPCA9846::enableCache()) to get the most out
+// of it: the port is then only selected when the selection changes, and all
+// adapters sharing a mux share that copy, so switching between sensors on the
+// same port costs no extra mux traffic. Without the cache, every transfer
+// selects the port first. A failed transfer drops the cache, so the next one
+// selects the port again.
+
+#pragma once
+
+#include "sfe_bus.h"
+#include "sfe_pca9846.h"
+
+namespace sfe_PCA9846
+{
+
+    class QwPortBus : public QwIDeviceBus
+    {
+    public:
+        // portNumber must be 0-3. With any other value, every transfer fails
+        QwPortBus(QwDevPCA9846 &mux, uint8_t portNumber);
+
+        uint8_t getPortNumber() { return _portNumber; }
+
+        //////////////////////////////////////////////////////////////////////////////////
+        // select()
+        //
+        // Connect the mux to this port, if it is not connected already.
+        // Called automatically by every transfer.
+        //
+        //  Parameter    Description
+        //  ---------    -----------------------------
+        //  retval       false = error, true = success
+
+        bool select();
+
+        bool ping(uint8_t address);
+
+        bool write(uint8_t address, uint8_t data);
+
+        bool writeRegisterByte(uint8_t address, uint8_t offset, uint8_t data);
+
+        bool writeRegisterRegion(uint8_t address, uint8_t offset, const uint8_t *data, uint16_t length);
+
+        bool read(uint8_t address, uint8_t *data);
+
+        bool readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length);
+
+        // Selects the port and transfers in one call (QwDevPCA9846::transferOnPort())
+        bool transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength);
+
+        // The same, for a scatter-gather transfer (QwDevPCA9846::transferSegmentsOnPort())
+        bool transferSegments(uint8_t address, const QwWriteSegment *tx, uint8_t txCount, const QwReadSegment *rx, uint8_t rxCount);
+
+        // Sets the clock profile of this port (QwDevPCA9846::setPortClock()). Applied when the port is selected
+        bool setClock(uint32_t clockHz) { return _mux.setPortClock(_portNumber, clockHz); }
+
+        // Errors and buffer size are those of the bus the mux is on
+        uint8_t getLastError();
+
+        uint16_t maxTransferLength();
+
+    private:
+        bool finish(bool success);
+
+        QwDevPCA9846 &_mux;
+        uint8_t _portNumber;
+    };
+
+};
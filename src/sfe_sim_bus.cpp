@@ -0,0 +1,474 @@
+// sfe_sim_bus.cpp
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Software model of a PCA9846 and its downstream devices. See sfe_sim_bus.h
+
+#include "sfe_sim_bus.h"
+#include "sfe_pca9846.h"
+
+namespace sfe_PCA9846
+{
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructor
+    //
+
+    QwSimBus::QwSimBus(uint8_t muxAddress) : _muxAddress{muxAddress}, _control{0}, _numDevices{0}, _faultyPorts{0}, _clock{100000},
+                                              _portMaxClock{0, 0, 0, 0}, _delay{nullptr}, _transactionBits{0}, _lastError{SFE_PCA9846_BUS_OK}
+    {
+        resetStats();
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // addDevice()
+    //
+    // Attach a downstream device to the model
+
+    bool QwSimBus::addDevice(uint8_t port, uint8_t address, uint8_t *registers, uint16_t size)
+    {
+        if (_numDevices >= SFE_PCA9846_SIM_MAX_DEVICES)
+            return false;
+
+        if ((port > 3) && (port != SFE_PCA9846_SIM_UPSTREAM))
+            return false;
+
+        SimDevice &device = _devices[_numDevices++];
+        device.port = port;
+        device.address = address;
+        device.registers = registers;
+        device.size = registers ? size : 0;
+        device.pointer = 0;
+
+        return true;
+    }
+
+    void QwSimBus::clearDevices()
+    {
+        _numDevices = 0;
+    }
+
+    void QwSimBus::resetStats()
+    {
+        _stats.transactions = 0;
+        _stats.bytes = 0;
+        _stats.bits = 0;
+        _stats.nacks = 0;
+        _stats.collisions = 0;
+        _stats.clockChanges = 0;
+        _stats.overclocked = 0;
+    }
+
+    void QwSimBus::setPortMaxClock(uint8_t port, uint32_t clockHz)
+    {
+        if (port < 4)
+            _portMaxClock[port] = clockHz;
+    }
+
+    bool QwSimBus::setClock(uint32_t clockHz)
+    {
+        if (clockHz != _clock)
+            _stats.clockChanges++;
+
+        _clock = clockHz;
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // busTimeMicros()
+    //
+    // Each bit time is one SCL period
+
+    uint32_t QwSimBus::busTimeMicros(uint32_t clockHz)
+    {
+        if (clockHz == 0)
+            return 0;
+
+        return (uint32_t)(((uint64_t)_stats.bits * 1000000 + clockHz - 1) / clockHz);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // account()
+    //
+    // START (or repeated START) + address byte + data bytes, each byte followed by an ACK bit.
+    // A STOP ends the transaction.
+
+    void QwSimBus::account(uint16_t length, bool stop)
+    {
+        uint32_t bits = 1 + 9 + (9 * (uint32_t)length);
+        _stats.bits += bits;
+        _stats.bytes += length;
+        _transactionBits += bits;
+        _lastError = SFE_PCA9846_BUS_OK;
+
+        if (stop)
+        {
+            _stats.bits += 1;
+            _stats.transactions++;
+
+            if (_delay && _clock)
+                _delay((uint32_t)(((uint64_t)(_transactionBits + 1) * 1000000 + _clock - 1) / _clock));
+            _transactionBits = 0;
+
+            for (uint8_t port = 0; port < 4; port++)
+            {
+                if ((_control & (1 << port)) && isTooFast(port))
+                {
+                    _stats.overclocked++;
+                    break;
+                }
+            }
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // nack()
+    //
+    // A transaction which was not acknowledged. The address byte (or, for the Device ID,
+    // the data byte) still went out on the wire.
+
+    void QwSimBus::nack(bool address)
+    {
+        if (address)
+            account(0);
+
+        _stats.nacks++;
+        _lastError = address ? SFE_PCA9846_BUS_ERROR_ADDR_NACK : SFE_PCA9846_BUS_ERROR_DATA_NACK;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // isStuck()
+    //
+    // A faulty port which is connected holds SDA low: nothing gets through, not even to the mux
+
+    bool QwSimBus::isStuck()
+    {
+        if (!(_control & _faultyPorts))
+            return false;
+
+        _stats.bits += 1;
+        _stats.transactions++;
+        _lastError = SFE_PCA9846_BUS_ERROR_OTHER;
+        return true;
+    }
+
+    bool QwSimBus::isVisible(const SimDevice &device)
+    {
+        if (device.port == SFE_PCA9846_SIM_UPSTREAM)
+            return true;
+
+        return ((_control & (1 << device.port)) != 0) && !isTooFast(device.port);
+    }
+
+    uint8_t QwSimBus::findDevices(uint8_t address, SimDevice **first)
+    {
+        uint8_t found = 0;
+
+        for (uint8_t i = 0; i < _numDevices; i++)
+        {
+            if ((_devices[i].address == address) && isVisible(_devices[i]))
+            {
+                if (found == 0)
+                    *first = &_devices[i];
+                found++;
+            }
+        }
+
+        return found;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // deviceWrite()
+    //
+    // A write is seen by every visible device at the address (this is what makes
+    // writing to several ports at once possible)
+
+    bool QwSimBus::deviceWrite(uint8_t address, bool setPointer, uint8_t offset, const uint8_t *data, uint16_t length)
+    {
+        bool acked = false;
+
+        for (uint8_t i = 0; i < _numDevices; i++)
+        {
+            SimDevice &device = _devices[i];
+
+            if ((device.address != address) || !isVisible(device))
+                continue;
+
+            acked = true;
+
+            if (setPointer)
+                device.pointer = offset;
+
+            for (uint16_t j = 0; j < length; j++)
+            {
+                if (device.pointer < device.size)
+                    device.registers[device.pointer] = data[j];
+                device.pointer++;
+            }
+        }
+
+        return acked;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // deviceRead()
+    //
+    // Reads from the register pointer of the visible device at address. Two devices
+    // driving SDA at once is flagged as a collision and treated as an error.
+
+    bool QwSimBus::deviceRead(uint8_t address, uint8_t *data, uint16_t length)
+    {
+        SimDevice *device = nullptr;
+        uint8_t found = findDevices(address, &device);
+
+        if (found == 0)
+            return false;
+
+        if (found > 1)
+        {
+            _stats.collisions++;
+            return false;
+        }
+
+        for (uint16_t i = 0; i < length; i++)
+        {
+            data[i] = (device->pointer < device->size) ? device->registers[device->pointer] : 0xFF;
+            device->pointer++;
+        }
+
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // ping()
+    //
+
+    bool QwSimBus::ping(uint8_t address)
+    {
+        if (isStuck())
+            return false;
+
+        SimDevice *device;
+        bool acked = isMux(address) || (address == SFE_PCA9846_MUX_DEVICE_ID_ADDRESS) || (findDevices(address, &device) > 0);
+
+        if (acked)
+            account(0);
+        else
+            nack();
+
+        return acked;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // write()
+    //
+    // A single byte written to the mux is the new control register value.
+    // A single byte written to a device sets its register pointer.
+
+    bool QwSimBus::write(uint8_t address, uint8_t data)
+    {
+        if (isStuck())
+            return false;
+
+        if (isMux(address))
+        {
+            account(1);
+            _control = data & 0x0F; // The new ports connect at the STOP
+            return true;
+        }
+
+        if (address == SFE_PCA9846_MUX_DEVICE_ID_ADDRESS)
+        {
+            account(1);
+            return true;
+        }
+
+        if (!deviceWrite(address, true, data, nullptr, 0))
+        {
+            nack();
+            return false;
+        }
+
+        account(1);
+        return true;
+    }
+
+    bool QwSimBus::writeRegisterByte(uint8_t address, uint8_t offset, uint8_t data)
+    {
+        return writeRegisterRegion(address, offset, &data, 1);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // writeRegisterRegion()
+    //
+    // The mux treats every byte as a new control register value - the last one wins
+
+    bool QwSimBus::writeRegisterRegion(uint8_t address, uint8_t offset, const uint8_t *data, uint16_t length)
+    {
+        if (isStuck())
+            return false;
+
+        if (isMux(address))
+        {
+            account(1 + length);
+            _control = (length > 0 ? data[length - 1] : offset) & 0x0F;
+            return true;
+        }
+
+        if (!deviceWrite(address, true, offset, data, length))
+        {
+            nack();
+            return false;
+        }
+
+        account(1 + length);
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // read()
+    //
+    // Reading the mux returns the control register
+
+    bool QwSimBus::read(uint8_t address, uint8_t *data)
+    {
+        if (isStuck())
+            return false;
+
+        if (isMux(address))
+        {
+            *data = _control;
+            account(1);
+            return true;
+        }
+
+        if (!deviceRead(address, data, 1))
+        {
+            nack();
+            return false;
+        }
+
+        account(1);
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // readRegisterRegion()
+    //
+    // Register pointer write, repeated START, then the read. The Device ID is read
+    // from address 0x7C using the mux address (shifted left by one) as the offset.
+
+    bool QwSimBus::readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length)
+    {
+        if (isStuck())
+            return false;
+
+        if (address == SFE_PCA9846_MUX_DEVICE_ID_ADDRESS)
+        {
+            if (offset != (uint8_t)(_muxAddress << 1))
+            {
+                account(1);
+                nack(false);
+                return false;
+            }
+
+            account(1, false);
+            for (uint8_t i = 0; i < length; i++)
+                data[i] = (uint8_t)(SFE_PCA9846_MUX_DEVICE_ID >> (8 * (2 - (i % 3))));
+            account(length);
+            return true;
+        }
+
+        if (isMux(address))
+        {
+            account(1, false);
+            for (uint8_t i = 0; i < length; i++)
+                data[i] = offset & 0x0F;
+            account(length);
+            _control = offset & 0x0F;
+            return true;
+        }
+
+        if (!deviceWrite(address, true, offset, nullptr, 0))
+        {
+            nack();
+            return false;
+        }
+
+        account(1, false);
+
+        if (!deviceRead(address, data, length))
+        {
+            account(0);
+            _lastError = SFE_PCA9846_BUS_ERROR_OTHER;
+            return false;
+        }
+
+        account(length);
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transfer()
+    //
+    // For a downstream device: the first byte written sets the register pointer, the rest are
+    // data. The mux and the Device ID address use the generic version.
+
+    bool QwSimBus::transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength)
+    {
+        if (isMux(address) || (address == SFE_PCA9846_MUX_DEVICE_ID_ADDRESS))
+            return QwIDeviceBus::transfer(address, tx, txLength, rx, rxLength);
+
+        if (isStuck())
+            return false;
+
+        bool setPointer = txLength > 0;
+
+        if (!deviceWrite(address, setPointer, setPointer ? tx[0] : 0, setPointer ? tx + 1 : nullptr, setPointer ? txLength - 1 : 0))
+        {
+            nack();
+            return false;
+        }
+
+        if (rxLength == 0)
+        {
+            account(txLength);
+            return true;
+        }
+
+        if (txLength > 0)
+            account(txLength, false); // Repeated START
+
+        if (!deviceRead(address, rx, rxLength))
+        {
+            account(0);
+            _lastError = SFE_PCA9846_BUS_ERROR_OTHER;
+            return false;
+        }
+
+        account(rxLength);
+        return true;
+    }
+
+}
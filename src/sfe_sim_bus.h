@@ -0,0 +1,176 @@
+// sfe_sim_bus.h
+//
+// SparkFun code, firmware, and software is released under the MIT
+// License(http://opensource.org/licenses/MIT).
+//
+// SPDX-License-Identifier: MIT
+//
+//    The MIT License (MIT)
+//
+//    Copyright (c) 2023 SparkFun Electronics
+//    Permission is hereby granted, free of charge, to any person obtaining a
+//    copy of this software and associated documentation files (the "Software"),
+//    to deal in the Software without restriction, including without limitation
+//    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+//    and/or sell copies of the Software, and to permit persons to whom the
+//    Software is furnished to do so, subject to the following conditions: The
+//    above copyright notice and this permission notice shall be included in all
+//    copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED
+//    "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+//    NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+//    ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// The QwSimBus class is a software model of an I2C bus with a PCA9846 mux
+// and a set of downstream devices attached to it. It implements QwIDeviceBus,
+// so QwDevPCA9846 (and any driver written against QwIDeviceBus) can run
+// against it without hardware - on an Arduino or on a desktop machine.
+//
+// Every transfer is accounted for: transactions, data bytes and the number of
+// bit times spent on the wire. busTimeMicros() converts the bit count into
+// bus time for a given SCL frequency.
+
+#pragma once
+
+#include "sfe_bus.h"
+
+// Maximum number of downstream devices the model can hold
+#ifndef SFE_PCA9846_SIM_MAX_DEVICES
+#define SFE_PCA9846_SIM_MAX_DEVICES 16
+#endif
+
+// Pass as the port number to attach a device directly to the upstream bus
+#define SFE_PCA9846_SIM_UPSTREAM 0xFF
+
+namespace sfe_PCA9846
+{
+    // Waits the given number of microseconds
+    typedef void (*QwSimDelayFunction)(uint32_t microseconds);
+
+    // Bus accounting
+    struct QwSimBusStats
+    {
+        uint32_t transactions; // START ... STOP sequences
+        uint32_t bytes;        // Data bytes moved, excluding address bytes
+        uint32_t bits;         // Bit times on the wire, including START/STOP and ACK bits
+        uint32_t nacks;        // Transactions that were not acknowledged
+        uint32_t collisions;   // Reads answered by more than one device
+        uint32_t clockChanges; // setClock() calls which changed the clock
+        uint32_t overclocked;  // Transactions faster than a connected port allows
+    };
+
+    class QwSimBus : public QwIDeviceBus
+    {
+    public:
+        QwSimBus(uint8_t muxAddress = 0x70);
+
+        //////////////////////////////////////////////////////////////////////////////////
+        // addDevice()
+        //
+        // Attach a downstream device to the model. The device is a flat register file
+        // supplied by the caller, accessed through an auto-incrementing register pointer.
+        //
+        //  Parameter    Description
+        //  ---------    -----------------------------
+        //  port         Mux port (0-3), or SFE_PCA9846_SIM_UPSTREAM
+        //  address      7-bit I2C address of the device
+        //  registers    Register file. May be nullptr for a device which only ACKs
+        //  size         Size of the register file
+        //  retval       false = no room left, true = success
+
+        bool addDevice(uint8_t port, uint8_t address, uint8_t *registers = nullptr, uint16_t size = 0);
+
+        // Remove all downstream devices
+        void clearDevices();
+
+        // Mux control register, as seen by the model
+        uint8_t getControl() { return _control; }
+        void setControl(uint8_t control) { _control = control & 0x0F; }
+
+        // Ports whose downstream bus is shorted. While one is connected, every transfer fails
+        void setFaultyPorts(uint8_t portMask) { _faultyPorts = portMask & 0x0F; }
+
+        // Model of the mux RESET pin: disconnects all ports
+        void hardwareReset() { _control = 0; }
+
+        // Fastest clock the devices on a port handle. Faster than that, they do not answer. 0 = no limit
+        void setPortMaxClock(uint8_t port, uint32_t clockHz);
+
+        uint32_t getClock() { return _clock; }
+
+        // Make each transaction take its bus time at the current clock, in real time, by calling
+        // delayFunction at its STOP. For timing tests of code which overlaps transfers. nullptr = off
+        void setDelayFunction(QwSimDelayFunction delayFunction) { _delay = delayFunction; }
+
+        void getStats(QwSimBusStats &stats) { stats = _stats; }
+        void resetStats();
+
+        // Bus time spent since the last resetStats(), in microseconds, at the given SCL frequency
+        uint32_t busTimeMicros(uint32_t clockHz);
+
+        bool ping(uint8_t address);
+
+        bool write(uint8_t address, uint8_t data);
+
+        bool writeRegisterByte(uint8_t address, uint8_t offset, uint8_t data);
+
+        bool writeRegisterRegion(uint8_t address, uint8_t offset, const uint8_t *data, uint16_t length);
+
+        bool read(uint8_t address, uint8_t *data);
+
+        bool readRegisterRegion(uint8_t address, uint8_t offset, uint8_t *data, uint8_t length);
+
+        uint8_t getLastError() { return _lastError; }
+
+        bool setClock(uint32_t clockHz);
+
+        bool transfer(uint8_t address, const uint8_t *tx, uint16_t txLength, uint8_t *rx, uint16_t rxLength);
+
+    private:
+        struct SimDevice
+        {
+            uint8_t port;
+            uint8_t address;
+            uint8_t *registers;
+            uint16_t size;
+            uint16_t pointer;
+        };
+
+        // Account for one address byte plus 'length' data bytes, with or without a STOP
+        void account(uint16_t length, bool stop = true);
+
+        // Account for a NACK, on the address byte or on a data byte
+        void nack(bool address = true);
+
+        bool isMux(uint8_t address) { return address == _muxAddress; }
+        bool isStuck();
+        bool isVisible(const SimDevice &device);
+        bool isTooFast(uint8_t port) { return _portMaxClock[port] && (_clock > _portMaxClock[port]); }
+
+        // Returns the number of visible devices at address. *first is set to the first one
+        uint8_t findDevices(uint8_t address, SimDevice **first);
+
+        // Write / read through every visible device at address
+        bool deviceWrite(uint8_t address, bool setPointer, uint8_t offset, const uint8_t *data, uint16_t length);
+        bool deviceRead(uint8_t address, uint8_t *data, uint16_t length);
+
+        uint8_t _muxAddress;
+        uint8_t _control;
+
+        SimDevice _devices[SFE_PCA9846_SIM_MAX_DEVICES];
+        uint8_t _numDevices;
+        uint8_t _faultyPorts;
+
+        uint32_t _clock;
+        uint32_t _portMaxClock[4];
+
+        QwSimDelayFunction _delay;
+        uint32_t _transactionBits; // Bit times since the last STOP
+
+        QwSimBusStats _stats;
+        uint8_t _lastError;
+    };
+
+};
@@ -0,0 +1,153 @@
+// test_arbiter.cpp
+//
+// Several threads lease ports of one mux through QwPCA9846Arbiter. While a lease
+// is held, no lease on another port may be held, the mux must stay on the
+// leased port, and reads through the lease must reach the sensor on that port.
+//
+// Fairness: threads re-leasing one port in a tight loop must not keep a lease on
+// another port waiting. Once it is waiting, no new lease on the busy port may be
+// granted.
+
+#include "sfe_pca9846_arbiter.h"
+#include "sfe_sim_bus.h"
+#include "test_common.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#define THREADS_PER_PORT 2
+#define LEASES_PER_THREAD 200
+
+#define HOG_THREADS 2
+#define FAIR_ROUNDS 50
+#define MAX_LEASES_PASSED 4 // Port 0 leases allowed while port 1 waits: those granted before it queued
+
+static sfe_PCA9846::QwSimBus simBus(SFE_PCA9846_MUX_DEFAULT_ADDRESS);
+static QwDevPCA9846 myMux;
+static uint8_t sensorRegisters[4][16];
+
+static std::atomic<int> holders[4];
+static std::atomic<int> overlaps(0);     // Leases granted while another port was leased
+static std::atomic<int> wrongPort(0);    // Leases granted with the mux on another port
+static std::atomic<int> wrongSensor(0);  // Reads which reached the sensor of another port
+static std::atomic<int> failedLeases(0);
+
+static void sleepMicros(uint32_t microseconds)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(microseconds));
+}
+
+static void leasePort(QwPCA9846Arbiter *arbiter, uint8_t port)
+{
+    for (int i = 0; i < LEASES_PER_THREAD; i++)
+    {
+        QwPCA9846Arbiter::Lease lease = arbiter->acquire(port);
+        if (!lease.isValid())
+        {
+            failedLeases++;
+            continue;
+        }
+
+        holders[port]++;
+        for (uint8_t other = 0; other < 4; other++)
+        {
+            if ((other != port) && (holders[other] != 0))
+                overlaps++;
+        }
+
+        if (simBus.getControl() != (1 << port))
+            wrongPort++;
+
+        uint8_t data[2] = {0, 0};
+        if (!lease.readRegisterRegion(0x48, 0x00, data, sizeof(data)) || (data[0] != port + 1))
+            wrongSensor++;
+
+        holders[port]--;
+    }
+}
+
+static std::atomic<bool> hogging(false);
+
+// Take and drop port 0 leases as fast as possible
+static void hogPort(QwPCA9846Arbiter *arbiter)
+{
+    while (hogging)
+        arbiter->acquire(0);
+}
+
+// The most port 0 leases granted while a port 1 lease was being acquired
+static uint32_t checkFairness(QwPCA9846Arbiter &arbiter)
+{
+    uint32_t worst = 0;
+
+    hogging = true;
+    std::thread hogs[HOG_THREADS];
+    for (uint8_t t = 0; t < HOG_THREADS; t++)
+        hogs[t] = std::thread(hogPort, &arbiter);
+
+    for (uint8_t round = 0; round < FAIR_ROUNDS; round++)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+        uint32_t before = arbiter.getLeases();
+        QwPCA9846Arbiter::Lease lease = arbiter.acquire(1);
+        uint32_t passed = arbiter.getLeases() - before - 1;
+
+        CHECK(lease.isValid());
+        if (passed > worst)
+            worst = passed;
+    }
+
+    hogging = false;
+    for (uint8_t t = 0; t < HOG_THREADS; t++)
+        hogs[t].join();
+
+    return worst;
+}
+
+int main()
+{
+    for (uint8_t port = 0; port < 4; port++)
+    {
+        holders[port] = 0;
+        sensorRegisters[port][0] = port + 1;
+        simBus.addDevice(port, 0x48, sensorRegisters[port], sizeof(sensorRegisters[port]));
+    }
+
+    simBus.setClock(400000);
+    simBus.setDelayFunction(sleepMicros);
+
+    myMux.setCommunicationBus(simBus, SFE_PCA9846_MUX_DEFAULT_ADDRESS);
+    CHECK(myMux.init());
+
+    QwPCA9846Arbiter arbiter(myMux);
+
+    QwPCA9846Arbiter::Lease none;
+    CHECK(!none.isValid());
+    CHECK_EQUAL(SFE_PCA9846_BUS_ERROR_NO_BUS, none.getLastError());
+    CHECK(!arbiter.acquire(4).isValid());
+
+    std::thread threads[4 * THREADS_PER_PORT];
+    for (uint8_t t = 0; t < 4 * THREADS_PER_PORT; t++)
+        threads[t] = std::thread(leasePort, &arbiter, t % 4);
+
+    for (uint8_t t = 0; t < 4 * THREADS_PER_PORT; t++)
+        threads[t].join();
+
+    CHECK_EQUAL(0, failedLeases);
+    CHECK_EQUAL(0, overlaps);
+    CHECK_EQUAL(0, wrongPort);
+    CHECK_EQUAL(0, wrongSensor);
+    CHECK_EQUAL(4 * THREADS_PER_PORT * LEASES_PER_THREAD, arbiter.getLeases());
+
+    printf("%u leases, %u port switches, %u waits\n", (unsigned)arbiter.getLeases(), (unsigned)arbiter.getSwitches(),
+           (unsigned)arbiter.getWaits());
+
+    simBus.setDelayFunction(nullptr); // As fast as possible, to give the hogs every chance
+    uint32_t passed = checkFairness(arbiter);
+    printf("At most %u port 0 leases granted while port 1 waited\n", (unsigned)passed);
+    CHECK(passed <= MAX_LEASES_PASSED);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,144 @@
+// test_bus_benchmark.cpp
+//
+// Bus cost of each public QwDevPCA9846 method, measured on QwSimBus and checked
+// against the expected transaction and byte counts below. A method which starts
+// using more of the bus fails the test. The modelled bus time at 100kHz, 400kHz
+// and 1MHz is printed alongside.
+//
+// If a change reduces the cost of a method on purpose, update its row.
+
+#include "sfe_pca9846.h"
+#include "sfe_sim_bus.h"
+#include "test_common.h"
+
+#include <string.h>
+
+struct Expected
+{
+    const char *method;
+    uint32_t transactions;
+    uint32_t bytes;
+};
+
+static const Expected kUncached[] = {
+    {"init", 2, 4},
+    {"isConnected", 1, 4},
+    {"getUniqueId", 1, 4},
+    {"setPort", 1, 1},
+    {"setPort (same port)", 1, 1},
+    {"getPort", 1, 1},
+    {"setPortState", 1, 1},
+    {"getPortState", 1, 1},
+    {"enablePort", 2, 2},
+    {"disablePort", 2, 2},
+    {"write", 1, 1},
+    {"read", 1, 1},
+    {"writeRegisterRegion", 1, 2},
+    {"readRegisterRegion", 1, 2},
+};
+
+static const Expected kCached[] = {
+    {"init", 2, 4},
+    {"isConnected", 1, 4},
+    {"getUniqueId", 1, 4},
+    {"setPort", 1, 1},
+    {"setPort (same port)", 0, 0},
+    {"getPort", 0, 0},
+    {"setPortState", 1, 1},
+    {"getPortState", 0, 0},
+    {"enablePort", 1, 1},
+    {"disablePort", 1, 1},
+    {"write", 1, 1},
+    {"read", 1, 1},
+    {"writeRegisterRegion", 1, 2},
+    {"readRegisterRegion", 1, 2},
+};
+
+static sfe_PCA9846::QwSimBus simBus(SFE_PCA9846_MUX_DEFAULT_ADDRESS);
+static QwDevPCA9846 myMux;
+static uint8_t sensorRegisters[4][16];
+
+static void report(const Expected *expected, uint8_t &step, const char *method)
+{
+    sfe_PCA9846::QwSimBusStats stats;
+    simBus.getStats(stats);
+
+    printf("%-22s %3u %3u %6u %6u %6u\n", method, stats.transactions, stats.bytes, simBus.busTimeMicros(100000),
+           simBus.busTimeMicros(400000), simBus.busTimeMicros(1000000));
+
+    CHECK(strcmp(expected[step].method, method) == 0);
+    CHECK_EQUAL(expected[step].transactions, stats.transactions);
+    CHECK_EQUAL(expected[step].bytes, stats.bytes);
+    step++;
+
+    simBus.resetStats();
+}
+
+static void runBenchmark(const Expected *expected)
+{
+    uint8_t buffer[8] = {0};
+    uint8_t step = 0;
+
+    printf("method                  tx  bytes us@100k us@400k us@1M\n");
+
+    simBus.resetStats();
+    myMux.init();
+    report(expected, step, "init");
+
+    myMux.isConnected();
+    report(expected, step, "isConnected");
+
+    myMux.getUniqueId();
+    report(expected, step, "getUniqueId");
+
+    myMux.setPort(1);
+    report(expected, step, "setPort");
+
+    myMux.setPort(1);
+    report(expected, step, "setPort (same port)");
+
+    myMux.getPort();
+    report(expected, step, "getPort");
+
+    myMux.setPortState(0x05);
+    report(expected, step, "setPortState");
+
+    myMux.getPortState();
+    report(expected, step, "getPortState");
+
+    myMux.enablePort(1);
+    report(expected, step, "enablePort");
+
+    myMux.disablePort(1);
+    report(expected, step, "disablePort");
+
+    myMux.write(0x02);
+    report(expected, step, "write");
+
+    myMux.read(buffer);
+    report(expected, step, "read");
+
+    myMux.writeRegisterRegion(0x01, buffer, 1);
+    report(expected, step, "writeRegisterRegion");
+
+    myMux.readRegisterRegion(0x01, buffer, 1);
+    report(expected, step, "readRegisterRegion");
+}
+
+int main()
+{
+    for (uint8_t port = 0; port < 4; port++)
+        simBus.addDevice(port, 0x48, sensorRegisters[port], sizeof(sensorRegisters[port]));
+
+    myMux.setCommunicationBus(simBus, SFE_PCA9846_MUX_DEFAULT_ADDRESS);
+
+    printf("Uncached:\n");
+    runBenchmark(kUncached);
+
+    myMux.enableCache();
+
+    printf("\nCached:\n");
+    runBenchmark(kCached);
+
+    return TEST_RESULT();
+}
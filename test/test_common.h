@@ -0,0 +1,33 @@
+// test_common.h
+//
+// Minimal check macros for the host tests. A failed check prints its location
+// and makes the test exit with a non-zero status.
+
+#pragma once
+
+#include <stdio.h>
+
+static int testFailures = 0;
+
+#define CHECK(condition)                                                                 \
+    do                                                                                   \
+    {                                                                                    \
+        if (!(condition))                                                                \
+        {                                                                                \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);        \
+            testFailures++;                                                              \
+        }                                                                                \
+    } while (0)
+
+#define CHECK_EQUAL(expected, actual)                                                    \
+    do                                                                                   \
+    {                                                                                    \
+        long long e_ = (long long)(expected), a_ = (long long)(actual);                  \
+        if (e_ != a_)                                                                    \
+        {                                                                                \
+            printf("%s:%d: %s: expected %lld, got %lld\n", __FILE__, __LINE__, #actual, e_, a_); \
+            testFailures++;                                                              \
+        }                                                                                \
+    } while (0)
+
+#define TEST_RESULT() (testFailures == 0 ? (printf("PASS\n"), 0) : (printf("FAIL: %d check(s)\n", testFailures), 1))
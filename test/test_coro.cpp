@@ -0,0 +1,136 @@
+// test_coro.cpp
+//
+// Coroutine tasks on two simulated muxes, each behind a QwPolledAsyncBus taking
+// a fixed number of polls per transfer. The executor is deterministic, so the
+// tick count of the run is checked against the expected value below, and must
+// be the same on every run.
+//
+// If a change makes the tasks finish in fewer ticks on purpose, update kTicks.
+//
+// Needs C++20.
+
+#include "sfe_pca9846_coro.h"
+#include "sfe_sim_bus.h"
+#include "test_common.h"
+
+#define BUSY_POLLS 3 // Polls each simulated transfer takes
+#define OTHER_WORK 10
+
+static const uint32_t kTicks = 41;
+
+struct Rig
+{
+    sfe_PCA9846::QwSimBus simBus;
+    QwDevPCA9846 mux;
+    sfe_PCA9846::QwPolledAsyncBus asyncBus;
+    QwDevPCA9846Coro coroMux;
+
+    Rig(uint8_t muxAddress, QwPCA9846Executor &executor)
+        : simBus(muxAddress), asyncBus(simBus, BUSY_POLLS), coroMux(mux, asyncBus, executor)
+    {
+        mux.setCommunicationBus(simBus, muxAddress);
+    }
+};
+
+static uint8_t sensorRegisters[2][4][16];
+static uint32_t wrongReads;
+static uint32_t failedOps;
+static uint32_t otherWork;
+
+static QwPCA9846Task readSensors(Rig &rig, uint8_t muxNumber)
+{
+    QwDevPCA9846Coro &coroMux = rig.coroMux;
+
+    for (uint8_t port = 0; port < 4; port++)
+    {
+        uint8_t data[2] = {0, 0};
+        if (!co_await coroMux.readRegisterRegion(port, 0x48, 0x00, data, sizeof(data)))
+            failedOps++;
+        else if ((data[0] != muxNumber + 1) || (data[1] != port))
+            wrongReads++;
+    }
+
+    // Left on the last port read
+    uint8_t portBits = 0;
+    if (!co_await coroMux.getPortState(portBits) || (portBits != 0x08))
+        failedOps++;
+
+    // Refused without touching the bus: a bad port, and a port taken out of service
+    uint8_t offset = 0;
+    uint8_t data;
+    if (co_await coroMux.transferOnPort(4, 0x48, &offset, 1, &data, 1))
+        failedOps++;
+
+    rig.mux.isolatePorts(0x04);
+    if (co_await coroMux.transferOnPort(2, 0x48, &offset, 1, &data, 1))
+        failedOps++;
+    rig.mux.isolatePorts(0);
+
+    if (!co_await coroMux.setPortState(0))
+        failedOps++;
+}
+
+static QwPCA9846Task doOtherWork(QwPCA9846Executor &executor)
+{
+    for (uint8_t i = 0; i < OTHER_WORK; i++)
+    {
+        otherWork++;
+        co_await executor.yield();
+    }
+}
+
+static uint32_t runTasks()
+{
+    QwPCA9846Executor executor;
+    Rig rigs[2] = {Rig(0x70, executor), Rig(0x71, executor)};
+
+    for (uint8_t m = 0; m < 2; m++)
+    {
+        for (uint8_t port = 0; port < 4; port++)
+            rigs[m].simBus.addDevice(port, 0x48, sensorRegisters[m][port], sizeof(sensorRegisters[m][port]));
+
+        CHECK(rigs[m].mux.init());
+        rigs[m].mux.enableCache();
+    }
+
+    wrongReads = 0;
+    failedOps = 0;
+    otherWork = 0;
+
+    CHECK(executor.spawn(readSensors(rigs[0], 0)));
+    CHECK(executor.spawn(readSensors(rigs[1], 1)));
+    CHECK(executor.spawn(doOtherWork(executor)));
+
+    uint32_t ticks = executor.run();
+
+    CHECK_EQUAL(0, executor.getTasks());
+    CHECK_EQUAL(0, wrongReads);
+    CHECK_EQUAL(0, failedOps);
+    CHECK_EQUAL(OTHER_WORK, otherWork);
+
+    for (uint8_t m = 0; m < 2; m++)
+        CHECK_EQUAL(0, rigs[m].simBus.getControl());
+
+    printf("%u ticks, %u resumes\n", (unsigned)ticks, (unsigned)executor.getResumes());
+    return ticks;
+}
+
+int main()
+{
+    for (uint8_t m = 0; m < 2; m++)
+    {
+        for (uint8_t port = 0; port < 4; port++)
+        {
+            sensorRegisters[m][port][0] = m + 1;
+            sensorRegisters[m][port][1] = port;
+        }
+    }
+
+    uint32_t first = runTasks();
+    uint32_t second = runTasks();
+
+    CHECK_EQUAL(kTicks, first);
+    CHECK_EQUAL(first, second);
+
+    return TEST_RESULT();
+}
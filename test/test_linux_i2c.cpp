@@ -0,0 +1,265 @@
+// test_linux_i2c.cpp
+//
+// QwLinuxI2C against a fake ioctl, which records the I2C_RDWR messages instead
+// of sending them. Checks the message layout - the STOP after the mux control
+// write, or a separate ioctl without I2C_FUNC_PROTOCOL_MANGLING, and write
+// segments joined by I2C_M_NOSTART - and the errno to error code mapping.
+
+#include "sfe_linux_i2c.h"
+#include "test_common.h"
+
+#include <errno.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <string.h>
+#include <vector>
+
+using namespace sfe_PCA9846;
+
+#define MUX_ADDRESS 0x70
+#define SENSOR_ADDRESS 0x48
+
+struct Message
+{
+    uint16_t address;
+    uint16_t flags;
+    std::vector<uint8_t> data; // Written bytes, or the length of a read
+};
+
+static unsigned long adapterFunctions;
+static int failWithErrno;
+static std::vector<std::vector<Message>> ioctls;
+
+// Records each I2C_RDWR. Reads return 0xA0, 0xA1, ... in every read message
+static int fakeIoctl(int fd, unsigned long request, void *argument)
+{
+    (void)fd;
+
+    if (request == I2C_FUNCS)
+    {
+        *(unsigned long *)argument = adapterFunctions;
+        return 0;
+    }
+
+    if (request != I2C_RDWR)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct i2c_rdwr_ioctl_data *rdwr = (struct i2c_rdwr_ioctl_data *)argument;
+    std::vector<Message> messages;
+
+    for (uint32_t i = 0; i < rdwr->nmsgs; i++)
+    {
+        struct i2c_msg &msg = rdwr->msgs[i];
+        Message message;
+        message.address = msg.addr;
+        message.flags = msg.flags;
+
+        if (msg.flags & I2C_M_RD)
+        {
+            message.data.resize(msg.len);
+            for (uint16_t j = 0; j < msg.len; j++)
+                msg.buf[j] = 0xA0 + j;
+        }
+        else
+        {
+            message.data.assign(msg.buf, msg.buf + msg.len);
+        }
+        messages.push_back(message);
+    }
+    ioctls.push_back(messages);
+
+    if (failWithErrno)
+    {
+        errno = failWithErrno;
+        return -1;
+    }
+    return rdwr->nmsgs;
+}
+
+static void attachAdapter(QwLinuxI2C &bus, unsigned long functions)
+{
+    adapterFunctions = functions;
+    failWithErrno = 0;
+    bus.setIoctlFunction(fakeIoctl);
+    CHECK(bus.attach(3));
+    ioctls.clear();
+}
+
+static void checkMessage(const Message &message, uint16_t address, uint16_t flags, const std::vector<uint8_t> &data)
+{
+    CHECK_EQUAL(address, message.address);
+    CHECK_EQUAL(flags, message.flags);
+    CHECK_EQUAL(data.size(), message.data.size());
+    CHECK(message.data == data);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Plain transfers
+//
+
+static void checkAttach()
+{
+    QwLinuxI2C bus;
+    bus.setIoctlFunction(fakeIoctl);
+
+    // An SMBus-only adapter has no I2C_RDWR
+    adapterFunctions = I2C_FUNC_SMBUS_BYTE;
+    CHECK(!bus.attach(3));
+    CHECK_EQUAL(SFE_PCA9846_BUS_ERROR_NO_BUS, bus.getLastError());
+
+    adapterFunctions = I2C_FUNC_I2C;
+    CHECK(bus.attach(3));
+    CHECK(!bus.canStopBetweenMessages());
+    CHECK(!bus.canJoinMessages());
+}
+
+static void checkRegisterRead()
+{
+    QwLinuxI2C bus;
+    attachAdapter(bus, I2C_FUNC_I2C);
+
+    uint8_t data[3] = {0};
+    CHECK(bus.readRegisterRegion(SENSOR_ADDRESS, 0x10, data, sizeof(data)));
+
+    // Pointer write and read in one ioctl, joined by a repeated START
+    CHECK_EQUAL(1, ioctls.size());
+    CHECK_EQUAL(2, ioctls[0].size());
+    checkMessage(ioctls[0][0], SENSOR_ADDRESS, 0, {0x10});
+    checkMessage(ioctls[0][1], SENSOR_ADDRESS, I2C_M_RD, {0, 0, 0});
+    CHECK_EQUAL(0xA2, data[2]);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// transferOnPort()
+//
+
+static void checkTransferOnPort()
+{
+    uint8_t tx[1] = {0x10};
+    uint8_t rx[2];
+
+    // Without protocol mangling, the control write is an ioctl of its own
+    QwLinuxI2C plain;
+    attachAdapter(plain, I2C_FUNC_I2C);
+
+    CHECK(plain.transferOnPort(MUX_ADDRESS, 0x04, SENSOR_ADDRESS, tx, sizeof(tx), rx, sizeof(rx)));
+    CHECK_EQUAL(2, ioctls.size());
+    CHECK_EQUAL(1, ioctls[0].size());
+    checkMessage(ioctls[0][0], MUX_ADDRESS, 0, {0x04});
+    CHECK_EQUAL(2, ioctls[1].size());
+    checkMessage(ioctls[1][0], SENSOR_ADDRESS, 0, {0x10});
+    checkMessage(ioctls[1][1], SENSOR_ADDRESS, I2C_M_RD, {0, 0});
+
+    // With it, one ioctl and a STOP after the control write
+    QwLinuxI2C mangling;
+    attachAdapter(mangling, I2C_FUNC_I2C | I2C_FUNC_PROTOCOL_MANGLING);
+
+    CHECK(mangling.transferOnPort(MUX_ADDRESS, 0x04, SENSOR_ADDRESS, tx, sizeof(tx), rx, sizeof(rx)));
+    CHECK_EQUAL(1, ioctls.size());
+    CHECK_EQUAL(3, ioctls[0].size());
+    checkMessage(ioctls[0][0], MUX_ADDRESS, I2C_M_STOP, {0x04});
+    checkMessage(ioctls[0][1], SENSOR_ADDRESS, 0, {0x10});
+    checkMessage(ioctls[0][2], SENSOR_ADDRESS, I2C_M_RD, {0, 0});
+    CHECK_EQUAL(0xA1, rx[1]);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// transferSegments()
+//
+
+static void checkSegments()
+{
+    const uint8_t header[2] = {0x20, 0x21};
+    const uint8_t payload[3] = {0x30, 0x31, 0x32};
+    QwWriteSegment tx[3] = {{header, sizeof(header)}, {nullptr, 0}, {payload, sizeof(payload)}};
+
+    uint8_t first[1], second[2];
+    QwReadSegment rx[2] = {{first, sizeof(first)}, {second, sizeof(second)}};
+
+    // Write segments joined by NOSTART, the empty one left out. The reads are one message,
+    // copied out to the segments
+    QwLinuxI2C nostart;
+    attachAdapter(nostart, I2C_FUNC_I2C | I2C_FUNC_NOSTART);
+
+    CHECK(nostart.transferSegments(SENSOR_ADDRESS, tx, 3, rx, 2));
+    CHECK_EQUAL(1, ioctls.size());
+    CHECK_EQUAL(3, ioctls[0].size());
+    checkMessage(ioctls[0][0], SENSOR_ADDRESS, 0, {0x20, 0x21});
+    checkMessage(ioctls[0][1], SENSOR_ADDRESS, I2C_M_NOSTART, {0x30, 0x31, 0x32});
+    checkMessage(ioctls[0][2], SENSOR_ADDRESS, I2C_M_RD, {0, 0, 0});
+    CHECK_EQUAL(0xA0, first[0]);
+    CHECK_EQUAL(0xA1, second[0]);
+    CHECK_EQUAL(0xA2, second[1]);
+
+    // Without NOSTART, the write segments are copied into one message
+    QwLinuxI2C copied;
+    attachAdapter(copied, I2C_FUNC_I2C);
+
+    CHECK(copied.transferSegments(SENSOR_ADDRESS, tx, 3, rx, 2));
+    CHECK_EQUAL(1, ioctls.size());
+    CHECK_EQUAL(2, ioctls[0].size());
+    checkMessage(ioctls[0][0], SENSOR_ADDRESS, 0, {0x20, 0x21, 0x30, 0x31, 0x32});
+    checkMessage(ioctls[0][1], SENSOR_ADDRESS, I2C_M_RD, {0, 0, 0});
+    CHECK_EQUAL(0xA2, second[1]);
+
+    // On a port: the STOP after the control write, then the joined segments
+    QwLinuxI2C both;
+    attachAdapter(both, I2C_FUNC_I2C | I2C_FUNC_PROTOCOL_MANGLING | I2C_FUNC_NOSTART);
+
+    CHECK(both.transferSegmentsOnPort(MUX_ADDRESS, 0x02, SENSOR_ADDRESS, tx, 3, rx, 2));
+    CHECK_EQUAL(1, ioctls.size());
+    CHECK_EQUAL(4, ioctls[0].size());
+    checkMessage(ioctls[0][0], MUX_ADDRESS, I2C_M_STOP, {0x02});
+    checkMessage(ioctls[0][1], SENSOR_ADDRESS, 0, {0x20, 0x21});
+    checkMessage(ioctls[0][2], SENSOR_ADDRESS, I2C_M_NOSTART, {0x30, 0x31, 0x32});
+    checkMessage(ioctls[0][3], SENSOR_ADDRESS, I2C_M_RD, {0, 0, 0});
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Errors
+//
+
+static void checkErrno(int error, uint8_t expected)
+{
+    QwLinuxI2C bus;
+    attachAdapter(bus, I2C_FUNC_I2C);
+
+    failWithErrno = error;
+    CHECK(!bus.ping(SENSOR_ADDRESS));
+    CHECK_EQUAL(error, bus.getLastErrno());
+    CHECK_EQUAL(expected, bus.getLastError());
+
+    // The next success clears it
+    failWithErrno = 0;
+    CHECK(bus.ping(SENSOR_ADDRESS));
+    CHECK_EQUAL(SFE_PCA9846_BUS_OK, bus.getLastError());
+}
+
+static void checkErrors()
+{
+    checkErrno(ENXIO, SFE_PCA9846_BUS_ERROR_ADDR_NACK);
+    checkErrno(EREMOTEIO, SFE_PCA9846_BUS_ERROR_DATA_NACK);
+    checkErrno(ETIMEDOUT, SFE_PCA9846_BUS_ERROR_TIMEOUT);
+    checkErrno(EIO, SFE_PCA9846_BUS_ERROR_OTHER);
+    checkErrno(EAGAIN, SFE_PCA9846_BUS_ERROR_OTHER);
+
+    // Not attached
+    QwLinuxI2C bus;
+    CHECK(!bus.ping(SENSOR_ADDRESS));
+    CHECK_EQUAL(SFE_PCA9846_BUS_ERROR_NO_BUS, bus.getLastError());
+    CHECK_EQUAL(EBADF, bus.getLastErrno());
+}
+
+int main()
+{
+    checkAttach();
+    checkRegisterRead();
+    checkTransferOnPort();
+    checkSegments();
+    checkErrors();
+
+    return TEST_RESULT();
+}
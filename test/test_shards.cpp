@@ -0,0 +1,225 @@
+// test_shards.cpp
+//
+// The same number of sensor reads per shard, run on 1, 2 and 4 shards of
+// QwPCA9846ShardedExecutor. Each shard is a QwSimBus which sleeps for the bus
+// time of every transfer, as a real controller would block. Jobs on different
+// shards must overlap, jobs on one shard must not, and every read must reach
+// the sensor on its own shard and port. The throughput is printed, but not
+// checked: it depends on how loaded the machine is.
+//
+// Also checks that a submit() waiting on a full queue gives up when the
+// executor stops, rather than queueing a job which never runs.
+
+#include "sfe_pca9846_shards.h"
+#include "sfe_sim_bus.h"
+#include "test_common.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#define MAX_SHARDS 4
+#define READS_PER_SHARD 200
+
+struct Target
+{
+    uint8_t shard;
+    uint8_t port;
+};
+
+static uint8_t sensorRegisters[MAX_SHARDS][4][16];
+static Target targets[MAX_SHARDS][4];
+
+static std::atomic<uint32_t> reads(0);
+static std::atomic<uint32_t> wrongSensor(0);
+
+// Jobs running at once, in total and on each shard
+static std::atomic<uint32_t> running(0);
+static std::atomic<uint32_t> maxRunning(0);
+static std::atomic<uint32_t> runningOnShard[MAX_SHARDS];
+static std::atomic<uint32_t> sameShardOverlaps(0);
+
+static void sleepMicros(uint32_t microseconds)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(microseconds));
+}
+
+static bool readSensor(sfe_PCA9846::QwIDeviceBus &bus, void *context)
+{
+    Target *target = (Target *)context;
+    uint8_t data[6];
+
+    uint32_t now = ++running;
+    uint32_t max = maxRunning;
+    while ((now > max) && !maxRunning.compare_exchange_weak(max, now))
+        ;
+    if (++runningOnShard[target->shard] > 1)
+        sameShardOverlaps++;
+
+    bool success = bus.readRegisterRegion(0x48, 0x00, data, sizeof(data));
+
+    runningOnShard[target->shard]--;
+    running--;
+
+    if (!success)
+        return false;
+
+    if ((data[0] != target->shard) || (data[1] != target->port))
+        wrongSensor++;
+
+    reads++;
+    return true;
+}
+
+// Most jobs running at once with the given number of shards
+static uint32_t runReads(uint8_t shards)
+{
+    sfe_PCA9846::QwSimBus simBus[MAX_SHARDS];
+    QwDevPCA9846 mux[MAX_SHARDS];
+    QwPCA9846ShardedExecutor executor;
+
+    for (uint8_t shard = 0; shard < shards; shard++)
+    {
+        for (uint8_t port = 0; port < 4; port++)
+            simBus[shard].addDevice(port, 0x48, sensorRegisters[shard][port], sizeof(sensorRegisters[shard][port]));
+
+        simBus[shard].setClock(400000);
+        simBus[shard].setDelayFunction(sleepMicros);
+
+        mux[shard].setCommunicationBus(simBus[shard], SFE_PCA9846_MUX_DEFAULT_ADDRESS);
+        CHECK(mux[shard].init());
+        CHECK_EQUAL(shard, executor.addShard(mux[shard]));
+    }
+
+    CHECK(executor.start());
+
+    reads = 0;
+    wrongSensor = 0;
+    maxRunning = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (uint16_t i = 0; i < READS_PER_SHARD; i++)
+    {
+        for (uint8_t shard = 0; shard < shards; shard++)
+        {
+            uint8_t port = i % 4;
+            CHECK(executor.submit(SFE_PCA9846_SHARD_PORT(shard, port), readSensor, &targets[shard][port]));
+        }
+    }
+
+    executor.wait();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK_EQUAL(shards * READS_PER_SHARD, reads);
+    CHECK_EQUAL(0, wrongSensor);
+    CHECK_EQUAL(0, sameShardOverlaps);
+
+    for (uint8_t shard = 0; shard < shards; shard++)
+    {
+        QwPCA9846ShardStats stats;
+        executor.getStats(shard, stats);
+        CHECK_EQUAL(READS_PER_SHARD, stats.jobs);
+        CHECK_EQUAL(0, stats.failures);
+    }
+
+    executor.stop();
+
+    printf("%u shard(s): %.0f reads/s, up to %u at once\n", shards, (shards * READS_PER_SHARD) / seconds,
+           (unsigned)maxRunning);
+    return maxRunning;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Stopping with a submit() waiting
+//
+
+static std::atomic<bool> stopCalled(false);
+static std::atomic<uint32_t> jobsRun(0);
+
+// Holds the shard's thread until stop() has been called, so the queue stays full
+static bool holdUntilStop(sfe_PCA9846::QwIDeviceBus &bus, void *context)
+{
+    (void)bus;
+    (void)context;
+
+    while (!stopCalled)
+        sleepMicros(100);
+    sleepMicros(10000); // For stop() to mark the shard stopping
+
+    jobsRun++;
+    return true;
+}
+
+static bool countJob(sfe_PCA9846::QwIDeviceBus &bus, void *context)
+{
+    (void)bus;
+    (void)context;
+
+    jobsRun++;
+    return true;
+}
+
+static void checkStopWhileWaiting()
+{
+    sfe_PCA9846::QwSimBus simBus;
+    QwDevPCA9846 mux;
+    QwPCA9846ShardedExecutor executor;
+
+    mux.setCommunicationBus(simBus, SFE_PCA9846_MUX_DEFAULT_ADDRESS);
+    CHECK(mux.init());
+    CHECK_EQUAL(0, executor.addShard(mux));
+    CHECK(executor.start());
+
+    // One job running, and a full queue behind it
+    CHECK(executor.submit(SFE_PCA9846_SHARD_PORT(0, 0), holdUntilStop));
+    QwPCA9846ShardStats stats;
+    do
+    {
+        sleepMicros(100);
+        executor.getStats(0, stats);
+    } while (stats.queued > 0);
+    for (uint8_t i = 0; i < SFE_PCA9846_SHARD_QUEUE_SIZE; i++)
+        CHECK(executor.submit(SFE_PCA9846_SHARD_PORT(0, 0), countJob));
+
+    std::atomic<bool> lateSubmitted(true);
+    std::thread submitter([&]() { lateSubmitted = executor.submit(SFE_PCA9846_SHARD_PORT(0, 0), countJob); });
+    sleepMicros(10000); // For the submitter to wait
+
+    stopCalled = true;
+    executor.stop();
+    submitter.join();
+
+    CHECK(!lateSubmitted);
+    CHECK_EQUAL(1 + SFE_PCA9846_SHARD_QUEUE_SIZE, jobsRun);
+    CHECK(!executor.isRunning());
+    CHECK(!executor.submit(SFE_PCA9846_SHARD_PORT(0, 0), countJob));
+}
+
+int main()
+{
+    for (uint8_t shard = 0; shard < MAX_SHARDS; shard++)
+    {
+        for (uint8_t port = 0; port < 4; port++)
+        {
+            sensorRegisters[shard][port][0] = shard;
+            sensorRegisters[shard][port][1] = port;
+            targets[shard][port] = {shard, port};
+        }
+    }
+
+    // Jobs block in the bus, not on a CPU, so shards overlap however loaded the machine is
+    uint32_t one = runReads(1);
+    uint32_t two = runReads(2);
+    uint32_t four = runReads(MAX_SHARDS);
+
+    CHECK_EQUAL(1, one);
+    CHECK_EQUAL(2, two);
+    CHECK(four >= 3);
+    CHECK(four <= MAX_SHARDS);
+
+    checkStopWhileWaiting();
+
+    return TEST_RESULT();
+}